@@ -0,0 +1,181 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "alloc.h"
+
+using std::string;
+
+// names of the sites in reports
+static const char* SITE_NAME[ALLOC_SITES] = {"other", "createMap", "resizeMap", "loadLevel", "render"};
+
+#ifdef DUNGEON_ALLOC_ACCOUNTING
+// size header in front of every block, keeping the block aligned for any type
+const size_t ALLOC_HEADER = alignof(std::max_align_t);
+
+// constant-initialized, so they are usable by allocations made before main
+static std::atomic<uint64_t> siteAllocations[ALLOC_SITES];
+static std::atomic<uint64_t> siteBytes[ALLOC_SITES];
+static std::atomic<uint64_t> liveBytes{0};
+static std::atomic<uint64_t> peakBytes{0};
+static thread_local int currentSite = ALLOC_OTHER;
+
+AllocationSite::AllocationSite(int site)
+    : previous(currentSite) {
+    currentSite = site;
+}
+
+AllocationSite::~AllocationSite() {
+    currentSite = previous;
+}
+
+/**
+ * Allocate a block with room for its size in front, and count it for the current site.
+ * @param   size        Bytes asked for.
+ * @return  block, or nullptr if malloc failed.
+ */
+static void* countedAlloc(size_t size) {
+    char* block = static_cast<char*>(std::malloc(size + ALLOC_HEADER));
+    if(block == nullptr){
+        return nullptr;
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+    siteAllocations[currentSite].fetch_add(1, std::memory_order_relaxed);
+    siteBytes[currentSite].fetch_add(size, std::memory_order_relaxed);
+    uint64_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while(live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)){
+    }
+    return block + ALLOC_HEADER;
+}
+
+/**
+ * Release a block from countedAlloc.
+ * @param   pointer     Block, or nullptr.
+ */
+static void countedFree(void* pointer) {
+    if(pointer == nullptr){
+        return;
+    }
+    char* block = static_cast<char*>(pointer) - ALLOC_HEADER;
+    liveBytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void* operator new(size_t size) {
+    void* pointer = countedAlloc(size);
+    if(pointer == nullptr){
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    countedFree(pointer);
+}
+
+/**
+ * @return  true if this build counts allocations.
+ */
+bool allocationAccounting() {
+    return true;
+}
+
+/**
+ * @return  allocations by site since the program started, and the live and peak bytes.
+ */
+AllocationStats allocationStats() {
+    AllocationStats stats;
+    for(int site = 0; site < ALLOC_SITES; ++site){
+        stats.sites[site].allocations = siteAllocations[site].load(std::memory_order_relaxed);
+        stats.sites[site].bytes = siteBytes[site].load(std::memory_order_relaxed);
+    }
+    stats.liveBytes = liveBytes.load(std::memory_order_relaxed);
+    stats.peakBytes = peakBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+/**
+ * Start measuring a new peak from the bytes live now.
+ */
+void resetAllocationPeak() {
+    peakBytes.store(liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+#else
+/**
+ * @return  true if this build counts allocations.
+ */
+bool allocationAccounting() {
+    return false;
+}
+
+/**
+ * @return  all zero, as this build does not count allocations.
+ */
+AllocationStats allocationStats() {
+    return AllocationStats();
+}
+
+/**
+ * Nothing to do, as this build does not count allocations.
+ */
+void resetAllocationPeak() {
+}
+#endif
+
+/**
+ * Render the allocations made between two snapshots, by site.
+ * @param   out         Text to print, appended to.
+ * @param   title       First line of the report.
+ * @param   now         Later snapshot; its peak is the peak of the period if it was reset at the start.
+ * @param   since       Earlier snapshot.
+ * @updates out
+ */
+void renderAllocations(string& out, const string& title, const AllocationStats& now, const AllocationStats& since) {
+    char line[120];
+    out += title + "\n";
+    std::snprintf(line, sizeof(line), "%-12s %12s %14s\n", "site", "allocations", "bytes");
+    out += line;
+    for(int site = 0; site < ALLOC_SITES; ++site){
+        std::snprintf(line, sizeof(line), "%-12s %12llu %14llu\n", SITE_NAME[site],
+                      static_cast<unsigned long long>(now.sites[site].allocations - since.sites[site].allocations),
+                      static_cast<unsigned long long>(now.sites[site].bytes - since.sites[site].bytes));
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "live bytes %llu, peak live bytes %llu\n",
+                  static_cast<unsigned long long>(now.liveBytes), static_cast<unsigned long long>(now.peakBytes));
+    out += line;
+}
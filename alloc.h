@@ -0,0 +1,60 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Allocation accounting replaces the global operator new and delete, so it is only compiled
+// into instrumentation builds: add -DDUNGEON_ALLOC_ACCOUNTING to the g++ line.
+
+// code that allocations are attributed to, innermost AllocationSite wins
+const int ALLOC_OTHER      = 0;
+const int ALLOC_CREATE_MAP = 1;     // createMap for a room or a relocated map
+const int ALLOC_RESIZE_MAP = 2;     // resizeMap, or growMap when journaling
+const int ALLOC_LOAD_LEVEL = 3;     // reading, parsing and caching a level
+const int ALLOC_RENDER     = 4;     // building frames
+const int ALLOC_SITES      = 5;
+
+// allocations made at one site
+struct AllocationCount {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+// totals since the program started
+struct AllocationStats {
+    std::array<AllocationCount, ALLOC_SITES> sites{};
+    uint64_t liveBytes = 0;
+    uint64_t peakBytes = 0;     // highest liveBytes since the last resetAllocationPeak
+};
+
+#ifdef DUNGEON_ALLOC_ACCOUNTING
+// attributes this thread's allocations to a site while in scope
+class AllocationSite {
+public:
+    explicit AllocationSite(int site);
+    ~AllocationSite();
+    AllocationSite(const AllocationSite&) = delete;
+    AllocationSite& operator=(const AllocationSite&) = delete;
+
+private:
+    int previous;
+};
+#else
+// accounting is compiled out, so sites cost nothing
+class AllocationSite {
+public:
+    explicit AllocationSite(int) {}
+};
+#endif
+
+// function signatures
+bool allocationAccounting();
+
+AllocationStats allocationStats();
+
+void resetAllocationPeak();
+
+void renderAllocations(std::string& out, const std::string& title, const AllocationStats& now, const AllocationStats& since);
+
+#endif
@@ -0,0 +1,109 @@
+#include <utility>
+#include "coro.h"
+
+SessionTask& SessionTask::operator=(SessionTask&& other) noexcept {
+    if(this != &other){
+        if(handle){
+            handle.destroy();
+        }
+        handle = other.handle;
+        other.handle = nullptr;
+    }
+    return *this;
+}
+
+SessionTask::~SessionTask() {
+    if(handle){
+        handle.destroy();
+    }
+}
+
+/**
+ * @return  true if a full line is waiting.
+ */
+bool Inbox::hasLine() const {
+    return pending.find('\n', pos) != std::string::npos;
+}
+
+/**
+ * Skip blanks and line breaks.
+ * @return  true if a command byte is waiting.
+ * @updates pos
+ */
+bool Inbox::hasCommand() {
+    while(pos < pending.size() && (pending[pos] == ' ' || pending[pos] == '\t' || pending[pos] == '\r' || pending[pos] == '\n')){
+        pos++;
+    }
+    return pos < pending.size();
+}
+
+/**
+ * Queue received bytes, dropping the already consumed prefix first.
+ * @param   bytes       Received bytes.
+ * @param   count       Number of received bytes.
+ * @updates pending, pos
+ */
+void Inbox::append(const char* bytes, size_t count) {
+    pending.erase(0, pos);
+    pos = 0;
+    pending.append(bytes, count);
+}
+
+std::string LineAwaiter::await_resume() const {
+    size_t end = inbox.pending.find('\n', inbox.pos);
+    if(end == std::string::npos){
+        // a closed inbox still gives its last, unterminated line
+        std::string rest = inbox.pending.substr(inbox.pos);
+        inbox.pos = inbox.pending.size();
+        return rest;
+    }
+    std::string line = inbox.pending.substr(inbox.pos, end - inbox.pos);
+    inbox.pos = end + 1;
+    return line;
+}
+
+char CommandAwaiter::await_resume() const {
+    if(!inbox.hasCommand()){
+        return 0;
+    }
+    return inbox.pending[inbox.pos++];
+}
+
+CoroScheduler::CoroScheduler(int threads, std::function<void(uint64_t)> onMigrate, std::function<void(uint64_t)> onYield)
+    : onMigrate(std::move(onMigrate)), onYield(std::move(onYield)), shards(threads, true) {
+}
+
+int CoroScheduler::size() const {
+    return shards.size();
+}
+
+/**
+ * Resume a suspended coroutine on the worker owning it. The caller must not schedule the same
+ * coroutine again before onYield reported it back.
+ * @param   id          Session id, used as the shard key and passed to the callbacks.
+ * @param   coroutine   Suspended coroutine.
+ */
+void CoroScheduler::schedule(uint64_t id, std::coroutine_handle<> coroutine) {
+    shards.submit(id, [this, id, coroutine](bool migrated) {
+        if(migrated){
+            onMigrate(id);
+        }
+        coroutine.resume();
+        onYield(id);
+    });
+}
+
+/**
+ * @param   id          Session that ended; its shard stops counting it.
+ */
+void CoroScheduler::forget(uint64_t id) {
+    shards.forget(id);
+}
+
+void CoroScheduler::stop() {
+    shards.stop();
+}
+
+std::vector<ShardStats> CoroScheduler::stats() const {
+    return shards.stats();
+}
@@ -0,0 +1,90 @@
+#ifndef CORO_H
+#define CORO_H
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <string>
+#include "shard.h"
+
+// coroutine that plays one session; it starts suspended and is driven by CoroScheduler
+class SessionTask {
+public:
+    struct promise_type {
+        SessionTask get_return_object() {
+            return SessionTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    SessionTask() : handle(nullptr) {}
+    explicit SessionTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    SessionTask(SessionTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    SessionTask& operator=(SessionTask&& other) noexcept;
+    SessionTask(const SessionTask&) = delete;
+    SessionTask& operator=(const SessionTask&) = delete;
+    ~SessionTask();
+
+    bool valid() const { return handle != nullptr; }
+    bool done() const { return handle == nullptr || handle.done(); }
+    std::coroutine_handle<> coroutine() const { return handle; }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+// bytes received for a session and not yet consumed by its coroutine
+struct Inbox {
+    std::string pending{};
+    size_t pos = 0;
+    bool closed = false;        // the peer closed its side; set by the event loop, no more input will arrive
+
+    bool hasLine() const;
+    bool hasCommand();
+    void append(const char* bytes, size_t count);
+};
+
+// co_await nextLine(inbox) gives the next line; once the inbox is closed, whatever is left of it, possibly empty
+struct LineAwaiter {
+    Inbox& inbox;
+    bool await_ready() const { return inbox.closed || inbox.hasLine(); }
+    void await_suspend(std::coroutine_handle<>) const {}
+    std::string await_resume() const;
+};
+
+// co_await nextCommand(inbox) gives the next non-blank byte, or 0 once the inbox is closed
+struct CommandAwaiter {
+    Inbox& inbox;
+    bool await_ready() const { return inbox.closed || inbox.hasCommand(); }
+    void await_suspend(std::coroutine_handle<>) const {}
+    char await_resume() const;
+};
+
+inline LineAwaiter nextLine(Inbox& inbox) { return LineAwaiter{inbox}; }
+inline CommandAwaiter nextCommand(Inbox& inbox) { return CommandAwaiter{inbox}; }
+
+// resumes suspended session coroutines on the worker that owns them; onMigrate runs on the
+// new worker before the first resume after a session moved, and when a coroutine suspends
+// again (waiting for input, or finished) onYield is called with its id on that worker
+class CoroScheduler {
+public:
+    CoroScheduler(int threads, std::function<void(uint64_t)> onMigrate, std::function<void(uint64_t)> onYield);
+    CoroScheduler(const CoroScheduler&) = delete;
+    CoroScheduler& operator=(const CoroScheduler&) = delete;
+
+    int size() const;
+    void schedule(uint64_t id, std::coroutine_handle<> coroutine);
+    void forget(uint64_t id);
+    void stop();
+    std::vector<ShardStats> stats() const;
+
+private:
+    std::function<void(uint64_t)> onMigrate;
+    std::function<void(uint64_t)> onYield;
+    ShardPool shards;
+};
+
+#endif
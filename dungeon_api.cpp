@@ -0,0 +1,160 @@
+#include <cstring>
+#include <new>
+#include "dungeon_api.h"
+#include "session.h"
+
+static_assert(DUNGEON_TURN_INVALID == TURN_INVALID && DUNGEON_TURN_CONTINUE == TURN_CONTINUE
+              && DUNGEON_TURN_QUIT == TURN_QUIT && DUNGEON_TURN_LEAVE == TURN_LEAVE
+              && DUNGEON_TURN_ESCAPE == TURN_ESCAPE && DUNGEON_TURN_DIED == TURN_DIED
+              && DUNGEON_TURN_ERROR == TURN_ERROR, "C turn codes must match session.h");
+
+// a level and the session currently played on it
+struct dungeon_game {
+    LevelTemplate level{};
+    GameSession session{};
+};
+
+/**
+ * Take ownership of a parsed level and start playing it.
+ * @param   game        Freshly allocated game holding the level.
+ * @return  the game, or nullptr (after freeing it) if the map could not be allocated.
+ */
+static dungeon_game* startGame(dungeon_game* game) {
+    if(dungeon_reset(game) != DUNGEON_OK){
+        delete game;
+        return nullptr;
+    }
+    return game;
+}
+
+dungeon_game* dungeon_load_file(const char* path) {
+    if(path == nullptr){
+        return nullptr;
+    }
+    try {
+        dungeon_game* game = new dungeon_game();
+        if(readLevelFile(path, game->level) != LEVEL_OK){
+            delete game;
+            return nullptr;
+        }
+        return startGame(game);
+    } catch(const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+dungeon_game* dungeon_load_buffer(const char* text, size_t length) {
+    if(text == nullptr){
+        return nullptr;
+    }
+    try {
+        dungeon_game* game = new dungeon_game();
+        if(!parseLevel(text, length, game->level)){
+            delete game;
+            return nullptr;
+        }
+        return startGame(game);
+    } catch(const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void dungeon_free(dungeon_game* game) {
+    delete game;
+}
+
+int dungeon_reset(dungeon_game* game) {
+    if(game == nullptr){
+        return DUNGEON_ERR_ARGUMENT;
+    }
+    GameSession& session = game->session;
+    session.total_rooms = 1;
+    session.current_room = 1;
+    session.total_moves = 0;
+    session.status = STATUS_STAY;
+    session.player.treasure = 0;
+    try {
+        return enterLevel(session, game->level) ? DUNGEON_OK : DUNGEON_ERR_NO_MAP;
+    } catch(const std::bad_alloc&) {
+        return DUNGEON_ERR_NO_MAP;
+    }
+}
+
+int dungeon_step(dungeon_game* game, char input) {
+    if(game == nullptr){
+        return DUNGEON_ERR_ARGUMENT;
+    }
+    if(game->session.map == nullptr){
+        return DUNGEON_ERR_NO_MAP;
+    }
+    try {
+        return stepSession(game->session, input);
+    } catch(const std::bad_alloc&) {
+        // the amulet could not grow the map; the session still holds the old one
+        return DUNGEON_TURN_ERROR;
+    }
+}
+
+int dungeon_step_batch(dungeon_game* const* games, const char* inputs, int* turns, size_t count) {
+    if(games == nullptr || inputs == nullptr){
+        return DUNGEON_ERR_ARGUMENT;
+    }
+    for(size_t i = 0; i < count; ++i){
+        int turn = dungeon_step(games[i], inputs[i]);
+        if(turns != nullptr){
+            turns[i] = turn;
+        }
+    }
+    return DUNGEON_OK;
+}
+
+int dungeon_size(const dungeon_game* game, int* rows, int* cols) {
+    if(game == nullptr || rows == nullptr || cols == nullptr){
+        return DUNGEON_ERR_ARGUMENT;
+    }
+    *rows = game->session.maxRow;
+    *cols = game->session.maxCol;
+    return DUNGEON_OK;
+}
+
+int dungeon_tiles(const dungeon_game* game, char* out, size_t capacity) {
+    if(game == nullptr || out == nullptr){
+        return DUNGEON_ERR_ARGUMENT;
+    }
+    const GameSession& session = game->session;
+    if(session.map == nullptr){
+        return DUNGEON_ERR_NO_MAP;
+    }
+    size_t width = static_cast<size_t>(session.maxCol);
+    if(capacity < width * session.maxRow){
+        return DUNGEON_ERR_CAPACITY;
+    }
+    for(int row = 0; row < session.maxRow; ++row){
+        std::memcpy(out + row * width, session.map[row], width);
+    }
+    return DUNGEON_OK;
+}
+
+char dungeon_tile(const dungeon_game* game, int row, int col) {
+    if(game == nullptr || game->session.map == nullptr){
+        return TILE_PILLAR;
+    }
+    const GameSession& session = game->session;
+    if(row < 0 || col < 0 || row >= session.maxRow || col >= session.maxCol){
+        return TILE_PILLAR;
+    }
+    return session.map[row][col];
+}
+
+int dungeon_player(const dungeon_game* game, dungeon_player_state* out) {
+    if(game == nullptr || out == nullptr){
+        return DUNGEON_ERR_ARGUMENT;
+    }
+    const GameSession& session = game->session;
+    out->row = session.player.row;
+    out->col = session.player.col;
+    out->treasure = session.player.treasure;
+    out->total_moves = session.total_moves;
+    out->status = session.status;
+    return DUNGEON_OK;
+}
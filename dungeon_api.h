@@ -0,0 +1,77 @@
+#ifndef DUNGEON_API_H
+#define DUNGEON_API_H
+/*
+ * C interface to the game logic, built as libdungeon from the sessions and everything they use:
+ *   g++ -std=c++17 -O2 -shared -fPIC -fvisibility=hidden -pthread -Wl,--no-undefined -o libdungeon.so \
+ *       dungeon_api.cpp session.cpp logic.cpp journal.cpp flowfield.cpp monsters.cpp spatial.cpp fog.cpp \
+ *       latency.cpp trace.cpp perfcounters.cpp metrics.cpp alloc.cpp
+ * -Wl,--no-undefined makes the link fail, rather than the first client, when a source is missing here.
+ *
+ * Every call that produces data writes into buffers owned by the caller; no call
+ * allocates except loading a level and a turn on which an amulet doubles the map.
+ */
+#include <stddef.h>
+
+#if defined(__GNUC__)
+#define DUNGEON_API __attribute__((visibility("default")))
+#else
+#define DUNGEON_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* turn outcomes, same values as the TURN_* constants in session.h */
+#define DUNGEON_TURN_INVALID  (-1)
+#define DUNGEON_TURN_CONTINUE 0
+#define DUNGEON_TURN_QUIT     1
+#define DUNGEON_TURN_LEAVE    2
+#define DUNGEON_TURN_ESCAPE   3
+#define DUNGEON_TURN_DIED     4
+#define DUNGEON_TURN_ERROR    5
+
+/* error codes, all negative and distinct from turn outcomes */
+#define DUNGEON_OK             0
+#define DUNGEON_ERR_ARGUMENT (-10)
+#define DUNGEON_ERR_CAPACITY (-11)
+#define DUNGEON_ERR_NO_MAP   (-12)
+
+typedef struct dungeon_game dungeon_game;
+
+typedef struct dungeon_player_state {
+    int row;
+    int col;
+    int treasure;
+    int total_moves;
+    int status;         /* STATUS_* of the last turn */
+} dungeon_player_state;
+
+/* load a single level; NULL if it cannot be read or is invalid */
+DUNGEON_API dungeon_game* dungeon_load_file(const char* path);
+DUNGEON_API dungeon_game* dungeon_load_buffer(const char* text, size_t length);
+DUNGEON_API void dungeon_free(dungeon_game* game);
+
+/* restart the level from its initial state */
+DUNGEON_API int dungeon_reset(dungeon_game* game);
+
+/* play one turn with a command character (w, a, s, d, e); returns a DUNGEON_TURN_* value */
+DUNGEON_API int dungeon_step(dungeon_game* game, char input);
+
+/* play one turn in each of count games; turns may be NULL */
+DUNGEON_API int dungeon_step_batch(dungeon_game* const* games, const char* inputs, int* turns, size_t count);
+
+DUNGEON_API int dungeon_size(const dungeon_game* game, int* rows, int* cols);
+
+/* copy rows * cols tiles, row-major, into out */
+DUNGEON_API int dungeon_tiles(const dungeon_game* game, char* out, size_t capacity);
+
+DUNGEON_API char dungeon_tile(const dungeon_game* game, int row, int col);
+
+DUNGEON_API int dungeon_player(const dungeon_game* game, dungeon_player_state* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
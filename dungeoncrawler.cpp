@@ -1,121 +1,178 @@
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <string>
+#include "alloc.h"
 #include "helper.h"
+#include "journal.h"
+#include "latency.h"
 #include "logic.h"
+#include "perfcounters.h"
+#include "realtime.h"
+#include "server.h"
+#include "session.h"
+#include "trace.h"
 using std::cin;
 using std::cout;
-using std::endl;
 using std::string;
-using std::ifstream;
 
-// g++ -std=c++17 -Wall -Wextra -pedantic-errors -Weffc++ -fsanitize=undefined,address *.cpp
-
-int main() {
-    // display greeting message
-    printInstructions();
-
-    string dungeon;
-    int total_rooms;
-    
-    Player player;
-
-    cout << "Please enter the dungeon name and number of levels: ";
-    cin >> dungeon >> total_rooms;
+/**
+ * Print the latency report to stderr, if latency is being measured.
+ * @param   profiler    Profiler of the game, or nullptr.
+ */
+static void printLatency(const TurnProfiler* profiler) {
+    if (profiler == nullptr) {
+        return;
+    }
+    string report;
+    renderProfile(report, *profiler);
+    std::cerr << report << std::flush;
+}
 
-    int total_moves = 0;
-    for(int current_room = 1; current_room <= total_rooms; current_room++) {
-        cout << "Level " << current_room << endl;
-        string fileName = dungeon + std::to_string(current_room) + ".txt";
+/**
+ * Write the recorded spans, if tracing, and the hardware event counts, if counting.
+ */
+static void writeReports() {
+    if (tracing() && !flushTrace()) {
+        std::cerr << "Cannot write the trace file" << std::endl;
+    }
+    if (counting()) {
+        string report;
+        renderCounters(report);
+        std::cerr << report << std::flush;
+    }
+}
 
-        // declare variables
-        int maxRow  = 0;
-        int maxCol  = 0;
-        int nextRow = 0;
-        int nextCol = 0;
+/**
+ * Print the allocations made since the mark, if this build counts them, and start a new period.
+ * @param   title       First line of the report.
+ * @param   mark        Snapshot at the start of the period.
+ * @updates mark
+ */
+static void printAllocations(const string& title, AllocationStats& mark) {
+    if (!allocationAccounting()) {
+        return;
+    }
+    AllocationStats now = allocationStats();
+    string report;
+    renderAllocations(report, title, now, mark);
+    std::cerr << report << std::flush;
+    mark = now;
+    resetAllocationPeak();
+}
 
-        // create map, or quit if map load error
-        char** map = loadLevel(fileName, maxRow, maxCol, player);
-        if (map == nullptr) {
-            cout << "Returning you back to the real word, adventurer!" << endl;
-            return 1;
+// g++ -std=c++20 -Wall -Wextra -pedantic-errors -Weffc++ -fsanitize=undefined,address -pthread *.cpp
+
+int main(int argc, char* argv[]) {
+    // server mode: dungeoncrawler --server <socket path> [--workers <count>]
+    //              [--metrics <prometheus text file> [--metrics-interval <seconds>]]
+    // saved game:  dungeoncrawler --load <save file>
+    // real time:   dungeoncrawler --realtime <ticks per second>
+    // fog of war:  dungeoncrawler --fog <sight radius>
+    // latency:     dungeoncrawler --latency, report on exit or on SIGUSR1
+    // tracing:     dungeoncrawler --trace <trace json>, written on exit
+    // counters:    dungeoncrawler --counters, hardware events of the hot functions, reported on exit
+    ServerConfig server;
+    string saveFile;
+    int tickHz = 0;
+    int fogRadius = 0;
+    bool latency = false;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--latency") == 0) {
+            latency = true;
+        } else if (std::strcmp(argv[i], "--counters") == 0) {
+            startCounters();
+        } else if (hasValue && std::strcmp(argv[i], "--load") == 0) {
+            saveFile = argv[++i];
+        } else if (hasValue && std::strcmp(argv[i], "--server") == 0) {
+            server.socketPath = argv[++i];
+        } else if (hasValue && std::strcmp(argv[i], "--workers") == 0) {
+            server.workers = std::atoi(argv[++i]);
+        } else if (hasValue && std::strcmp(argv[i], "--metrics") == 0) {
+            server.metricsPath = argv[++i];
+        } else if (hasValue && std::strcmp(argv[i], "--metrics-interval") == 0) {
+            server.metricsSeconds = std::atoi(argv[++i]);
+        } else if (hasValue && std::strcmp(argv[i], "--realtime") == 0) {
+            tickHz = std::atoi(argv[++i]);
+            tickHz = tickHz > 0 ? tickHz : DEFAULT_TICK_HZ;
+        } else if (hasValue && std::strcmp(argv[i], "--trace") == 0) {
+            startTrace(argv[++i]);
+        } else if (hasValue && std::strcmp(argv[i], "--fog") == 0) {
+            fogRadius = std::atoi(argv[++i]);
+            fogRadius = fogRadius > 0 ? fogRadius : FOG_DEFAULT_RADIUS;
         }
-        
-        // display map
-        outputMap(map, maxRow, maxCol);
-
-        // move player
-        char input = 0;
-        int status = 0;
-        while (true) {
-            // get user input
-            cout << "Enter command (w,a,s,d: move, e: stay still, q: quit): ";
-            cin >> input;
-
-            // quit game if user inputs quit
-            if (input == INPUT_QUIT) {
-                cout << "Thank you for playing!" << endl;
-                deleteMap(map, maxRow);
-                return 0;
-            } 
-
-            // reprompt if invalid command
-            if (input !=  MOVE_UP && input != MOVE_LEFT && input != MOVE_DOWN && input != MOVE_RIGHT && input != INPUT_STAY) {
-                cout << "I did not understand your command, adventurer!" << endl;
-                continue;
-            }
-
-            // increment dungeon movement counter
-            total_moves++;
-            if (input == INPUT_STAY) {
-                status = STATUS_STAY;
-            } else {
-                // translate from the character input to a direction
-                // we will use the player's current location and pass-by-reference to find the intended next location
-                nextRow = player.row;
-                nextCol = player.col;
-                getDirection(input, nextRow, nextCol);
-
-                // move player to new location index, if possible, and get player status
-                status = doPlayerMove(map, maxRow, maxCol, player, nextRow, nextCol);
-            }
-
-            // quit game if user escapes
-            if (status == STATUS_ESCAPE) {
-                outputMap(map, maxRow, maxCol);
-                outputStatus(status, player, total_moves);
-                deleteMap(map, maxRow);
-                return 0;
-            }
+    }
+    if (!server.socketPath.empty()) {
+        int code = runServer(server);
+        writeReports();
+        return code;
+    }
 
-            // go to next level if user goes through door
-            if (status == STATUS_LEAVE) {
-				outputMap(map, maxRow, maxCol);
-                outputStatus(status, player, total_moves);
-                break;
-            }
+    // display greeting message
+    printInstructions();
 
-            // move monsters, end if player is caught
-            if (doMonsterAttack(map, maxRow, maxCol, player)) {
-                outputMap(map, maxRow, maxCol);
-                cout << "You died, adventurer! Better luck next time!" << endl;
-                deleteMap(map, maxRow);
-                return 0;
-            }
+    // keep an undo history of the current room
+    Journal journal;
+    GameSession session;
+    session.journal = &journal;
+    session.fog.radius = fogRadius;
+    std::unique_ptr<TurnProfiler> profiler;
+    if (latency) {
+        profiler.reset(new TurnProfiler());
+        session.profiler = profiler.get();
+        watchProfileSignal();
+    }
+    string frame;
+    int result = GAME_RUNNING;
+    AllocationStats allocationMark = allocationStats();
+    if (!saveFile.empty()) {
+        // pick up a saved quest where it was left
+        result = resumeGame(session, saveFile, frame);
+    } else {
+        string dungeon;
+        int total_rooms;
+
+        cout << "Please enter the dungeon name and number of levels: ";
+        cin >> dungeon >> total_rooms;
+
+        // create map of the first room, or quit if map load error
+        result = beginGame(session, dungeon, total_rooms, frame);
+    }
+    cout << frame << std::flush;
+
+    // monsters keep moving on a fixed tick whether or not the player types
+    if (tickHz > 0 && result == GAME_RUNNING) {
+        TickStats ticks;
+        result = runRealtime(session, tickHz, ticks);
+        printTickStats(ticks, tickHz);
+        printLatency(profiler.get());
+        printAllocations("allocations while playing", allocationMark);
+        writeReports();
+        return result;
+    }
 
-            // use amulet
-            if (status == STATUS_AMULET) {
-                map = resizeMap(map, maxRow, maxCol);
-            }
-            
-            // display map and status
-            outputMap(map, maxRow, maxCol);
-            outputStatus(status, player, total_moves);
-            
+    // play until the game ends
+    char input = 0;
+    while (result == GAME_RUNNING) {
+        // get user input
+        cout << COMMAND_PROMPT;
+        cin >> input;
+
+        frame.clear();
+        int room = session.current_room;
+        result = playTurn(session, input, frame);
+        cout << frame << std::flush;
+        if (profileRequested()) {
+            printLatency(profiler.get());
+        }
+        // a room's period ends with the turn that leaves it, so it includes loading the next room
+        if (session.current_room != room || result != GAME_RUNNING) {
+            printAllocations("allocations in room " + std::to_string(room), allocationMark);
         }
-
-        // delete map
-        deleteMap(map, maxRow);
     }
-    return 0;
+    printLatency(profiler.get());
+    writeReports();
+    return result;
 }
@@ -0,0 +1,165 @@
+#include <cstring>
+#include "env.h"
+
+// command characters for each ACTION_* value
+static const char ACTION_INPUT[ACTION_COUNT] = {INPUT_STAY, MOVE_UP, MOVE_LEFT, MOVE_DOWN, MOVE_RIGHT};
+
+/**
+ * splitmix64 step, used to give every environment its own reproducible random stream.
+ * @param   state       Generator state.
+ * @return  next random value.
+ * @updates state
+ */
+static uint64_t nextRandom(uint64_t& state) {
+    state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+VecEnv::VecEnv(const EnvConfig& config)
+    : config(config), sessions(), rngState(config.numEnvs, 0), episodeSteps(config.numEnvs, 0),
+      obsStride(::observationBytes(config.format, config.window)),
+      obs(config.numEnvs * obsStride, static_cast<uint8_t>(TILE_PILLAR)),
+      scratch(config.format == OBS_TILES ? 0 : static_cast<size_t>(config.numEnvs) * config.window * config.window),
+      reward(config.numEnvs, 0.0f), done(config.numEnvs, 0), pool(config.numThreads), loaded(true) {
+    // warm the level cache up front so resets never touch the file system
+    for(const EnvDungeon& dungeon : config.dungeons){
+        for(int room = 1; room <= dungeon.rooms; ++room){
+            if(cachedLevel(roomFileName(dungeon.name, room)) == nullptr){
+                loaded = false;
+            }
+        }
+    }
+    if(config.dungeons.empty()){
+        loaded = false;
+    }
+    for(int env = 0; env < config.numEnvs; ++env){
+        sessions.emplace_back(new GameSession());
+    }
+}
+
+bool VecEnv::valid() const {
+    return loaded;
+}
+
+int VecEnv::numEnvs() const {
+    return config.numEnvs;
+}
+
+int VecEnv::window() const {
+    return config.window;
+}
+
+const uint8_t* VecEnv::observations() const {
+    return obs.data();
+}
+
+size_t VecEnv::observationBytes() const {
+    return obsStride;
+}
+
+const float* VecEnv::rewards() const {
+    return reward.data();
+}
+
+const uint8_t* VecEnv::dones() const {
+    return done.data();
+}
+
+const GameSession& VecEnv::session(int env) const {
+    return *sessions[env];
+}
+
+/**
+ * Seed every environment's random stream and start a new episode in each of them.
+ * @param   seed        Seed for the whole batch; environment i uses seed + i.
+ */
+void VecEnv::reset(uint64_t seed) {
+    if(!loaded){
+        return;
+    }
+    pool.parallelFor(config.numEnvs, [this, seed](int begin, int end) {
+        for(int env = begin; env < end; ++env){
+            rngState[env] = seed + static_cast<uint64_t>(env);
+            reward[env] = 0.0f;
+            done[env] = 0;
+            resetEnv(env);
+        }
+    });
+}
+
+/**
+ * Start a new episode in a randomly picked dungeon and refresh its observation.
+ * @param   env         Environment index.
+ */
+void VecEnv::resetEnv(int env) {
+    const EnvDungeon& dungeon = config.dungeons[nextRandom(rngState[env]) % config.dungeons.size()];
+    startSession(*sessions[env], dungeon.name, dungeon.rooms);
+    episodeSteps[env] = 0;
+    observe(env);
+}
+
+void VecEnv::step(const uint8_t* actions) {
+    if(!loaded){
+        return;
+    }
+    pool.parallelFor(config.numEnvs, [this, actions](int begin, int end) {
+        stepRange(actions, begin, end);
+    });
+}
+
+/**
+ * Step the environments [begin, end), filling their rewards and dones.
+ * @param   actions     One ACTION_* per environment.
+ * @param   begin       First environment.
+ * @param   end         One past the last environment.
+ */
+void VecEnv::stepRange(const uint8_t* actions, int begin, int end) {
+    for(int env = begin; env < end; ++env){
+        GameSession& session = *sessions[env];
+        uint8_t action = actions[env] < ACTION_COUNT ? actions[env] : ACTION_STAY;
+        int turn = stepSession(session, ACTION_INPUT[action]);
+        episodeSteps[env]++;
+
+        float gained = REWARD_STEP;
+        bool finished = false;
+        if(session.status == STATUS_TREASURE){
+            gained += REWARD_TREASURE;
+        }
+        if(turn == TURN_LEAVE){
+            gained += REWARD_LEAVE;
+            finished = !hasNextRoom(session) || !enterRoom(session, session.current_room + 1);
+        } else if(turn == TURN_ESCAPE){
+            gained += REWARD_ESCAPE;
+            finished = true;
+        } else if(turn == TURN_DIED){
+            gained += REWARD_DEATH;
+            finished = true;
+        } else if(turn == TURN_ERROR){
+            finished = true;
+        }
+        if(episodeSteps[env] >= config.maxSteps){
+            finished = true;
+        }
+
+        reward[env] = gained;
+        done[env] = finished ? 1 : 0;
+        if(finished){
+            resetEnv(env);
+        } else {
+            observe(env);
+        }
+    }
+}
+
+/**
+ * Encode the window around the player into the environment's observation slot.
+ * @param   env         Environment index.
+ */
+void VecEnv::observe(int env) {
+    size_t cells = static_cast<size_t>(config.window) * config.window;
+    uint8_t* tiles = scratch.empty() ? nullptr : &scratch[env * cells];
+    observeSession(*sessions[env], config.window, config.format, &obs[env * obsStride], tiles);
+}
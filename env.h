@@ -0,0 +1,87 @@
+#ifndef ENV_H
+#define ENV_H
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "observe.h"
+#include "session.h"
+#include "threadpool.h"
+
+// actions accepted by VecEnv::step, one byte per environment
+const uint8_t ACTION_STAY  = 0;
+const uint8_t ACTION_UP    = 1;
+const uint8_t ACTION_LEFT  = 2;
+const uint8_t ACTION_DOWN  = 3;
+const uint8_t ACTION_RIGHT = 4;
+const int     ACTION_COUNT = 5;
+
+// rewards handed out per step
+const float REWARD_STEP     = -0.01f;
+const float REWARD_TREASURE = 1.0f;
+const float REWARD_LEAVE    = 1.0f;
+const float REWARD_ESCAPE   = 10.0f;
+const float REWARD_DEATH    = -10.0f;
+
+// one dungeon an environment can be reset into
+struct EnvDungeon {
+    std::string name;
+    int rooms = 1;
+};
+
+struct EnvConfig {
+    std::vector<EnvDungeon> dungeons{};
+    int numEnvs = 1;
+    int numThreads = 1;
+    int window = 11;            // observations are window x window tiles centered on the player, must be odd
+    int format = OBS_TILES;     // OBS_* encoding of the observations
+    int maxSteps = 1000;        // episodes are cut off after this many steps
+};
+
+// many game sessions stepped together; observations, rewards and dones live in
+// contiguous buffers owned by the environment and are overwritten by every reset/step
+class VecEnv {
+public:
+    explicit VecEnv(const EnvConfig& config);
+    VecEnv(const VecEnv&) = delete;
+    VecEnv& operator=(const VecEnv&) = delete;
+
+    // false if any configured dungeon could not be loaded
+    bool valid() const;
+
+    void reset(uint64_t seed);
+
+    // actions holds numEnvs() ACTION_* bytes; finished environments are reset right away,
+    // so the observation of a done environment is the first one of its next episode
+    void step(const uint8_t* actions);
+
+    int numEnvs() const;
+    int window() const;
+
+    // numEnvs() * observationBytes() bytes in the configured OBS_* encoding, TILE_PILLAR outside the map
+    const uint8_t* observations() const;
+    size_t observationBytes() const;
+    const float* rewards() const;
+    const uint8_t* dones() const;
+
+    const GameSession& session(int env) const;
+
+private:
+    void resetEnv(int env);
+    void stepRange(const uint8_t* actions, int begin, int end);
+    void observe(int env);
+
+    EnvConfig config;
+    std::vector<std::unique_ptr<GameSession>> sessions;
+    std::vector<uint64_t> rngState;
+    std::vector<int> episodeSteps;
+    size_t obsStride;
+    std::vector<uint8_t> obs;
+    std::vector<uint8_t> scratch;   // one window of raw tiles per environment, for encoded formats
+    std::vector<float> reward;
+    std::vector<uint8_t> done;
+    WorkerPool pool;
+    bool loaded;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include <cstdlib>
+#include "flowfield.h"
+
+// a repair bumps shift by one, so rebuild long before stored distances could wrap
+static const int32_t SHIFT_LIMIT = 1 << 30;
+
+/**
+ * @param   tile    Map tile.
+ * @return  true if a monster can walk over the tile. Doors and the exit are the player's way out.
+ */
+bool flowWalkable(char tile) {
+    return tile != TILE_PILLAR && tile != TILE_DOOR && tile != TILE_EXIT;
+}
+
+/**
+ * Forget the field, so the next update rebuilds it. Called whenever the map is replaced.
+ * @param   field       Field to clear.
+ * @updates field
+ */
+void resetFlowField(FlowField& field) {
+    field.map = nullptr;
+    field.maxRow = 0;
+    field.maxCol = 0;
+    field.width = 0;
+    field.fromRow = -1;
+    field.fromCol = -1;
+    field.shift = 0;
+}
+
+/**
+ * @param   field       Field the index is for.
+ * @param   row         Cell row.
+ * @param   col         Cell column.
+ * @return  index of the cell in the field's bordered layout.
+ */
+static size_t cellIndex(const FlowField& field, int row, int col) {
+    return static_cast<size_t>(row + 1) * field.width + col + 1;
+}
+
+/**
+ * Breadth-first search from the queued cells, lowering every open neighbor whose stored
+ * distance is more than one above the cell it is reached from. With a single seed over a
+ * field of FLOW_BLOCKED this is a plain BFS; over a field of valid upper bounds it lowers
+ * exactly the cells whose distance dropped. The closed border stands in for bounds checks.
+ * @param   field       Field with the seed cells in its queue.
+ * @updates field
+ */
+static void relax(FlowField& field) {
+    int32_t* dist = field.dist.data();
+    const uint8_t* open = field.open.data();
+    const int32_t width = field.width;
+    for(size_t head = 0; head < field.queue.size(); ++head){
+        int32_t cell = field.queue[head];
+        int32_t next = dist[cell] + 1;
+        const int32_t neighbor[4] = {cell - width, cell + width, cell + 1, cell - 1};
+        for(int32_t other : neighbor){
+            if(open[other] && dist[other] > next){
+                dist[other] = next;
+                field.queue.push_back(other);
+            }
+        }
+    }
+    field.queue.clear();
+}
+
+/**
+ * Rebuild the field from scratch with a BFS from the player over every walkable cell.
+ * @param   field       Field to fill.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   player      Player the distances are measured from.
+ * @updates field
+ */
+void buildFlowField(FlowField& field, char** map, int maxRow, int maxCol, const Player& player) {
+    field.map = map;
+    field.maxRow = maxRow;
+    field.maxCol = maxCol;
+    field.width = maxCol + 2;
+    size_t cells = static_cast<size_t>(maxRow + 2) * field.width;
+    field.dist.assign(cells, FLOW_BLOCKED);
+    field.open.assign(cells, 0);
+    for(int row = 0; row < maxRow; ++row){
+        uint8_t* open = &field.open[cellIndex(field, row, 0)];
+        for(int col = 0; col < maxCol; ++col){
+            open[col] = flowWalkable(map[row][col]) ? 1 : 0;
+        }
+    }
+    field.fromRow = player.row;
+    field.fromCol = player.col;
+    field.shift = 0;
+    size_t start = cellIndex(field, player.row, player.col);
+    field.dist[start] = 0;
+    field.queue.clear();
+    field.queue.push_back(static_cast<int32_t>(start));
+    relax(field);
+}
+
+/**
+ * Bring the field up to date with the player's cell. A one-cell step changes every distance
+ * by at most one, so instead of a new BFS every distance is raised by one at once (through
+ * shift) and only the cells that got closer are lowered again, starting at the player.
+ * Anything else, a jump, a new room or a resized map, rebuilds the field.
+ * @param   field       Field to update.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   player      Player the distances are measured from.
+ * @updates field
+ */
+void updateFlowField(FlowField& field, char** map, int maxRow, int maxCol, const Player& player) {
+    if(field.map != map || field.maxRow != maxRow || field.maxCol != maxCol || field.shift >= SHIFT_LIMIT){
+        buildFlowField(field, map, maxRow, maxCol, player);
+        return;
+    }
+    int step = std::abs(player.row - field.fromRow) + std::abs(player.col - field.fromCol);
+    if(step == 0){
+        return;
+    }
+    if(step > 1){
+        buildFlowField(field, map, maxRow, maxCol, player);
+        return;
+    }
+    field.shift++;
+    field.fromRow = player.row;
+    field.fromCol = player.col;
+    size_t start = cellIndex(field, player.row, player.col);
+    field.dist[start] = -field.shift;
+    field.queue.push_back(static_cast<int32_t>(start));
+    relax(field);
+}
+
+/**
+ * @param   field       Up-to-date field.
+ * @param   row         Cell row.
+ * @param   col         Cell column.
+ * @return  number of steps from the cell to the player, or -1 if the player cannot be reached.
+ */
+int flowDistance(const FlowField& field, int row, int col) {
+    int32_t stored = field.dist[cellIndex(field, row, col)];
+    return stored == FLOW_BLOCKED ? -1 : stored + field.shift;
+}
@@ -0,0 +1,35 @@
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+#include <cstdint>
+#include <vector>
+#include "logic.h"
+
+// distance of a cell no monster can ever stand on, or that the player cannot be reached from
+const int32_t FLOW_BLOCKED = INT32_MAX;
+
+// breadth-first distances from the player's cell, shared by every chasing monster of a room
+struct FlowField {
+    std::vector<int32_t> dist{};    // row-major with a one-cell border; real distance is dist + shift unless FLOW_BLOCKED
+    std::vector<uint8_t> open{};    // 1 where a monster can walk, same layout; the border is never open
+    std::vector<int32_t> queue{};   // scratch BFS queue of cell indices
+    char** map = nullptr;           // map the field was built for
+    int maxRow = 0;
+    int maxCol = 0;
+    int width = 0;                  // maxCol + 2
+    int fromRow = -1;               // player cell the distances are measured from
+    int fromCol = -1;
+    int32_t shift = 0;              // added to every stored distance, bumped on each incremental repair
+};
+
+// function signatures
+bool flowWalkable(char tile);
+
+void resetFlowField(FlowField& field);
+
+void buildFlowField(FlowField& field, char** map, int maxRow, int maxCol, const Player& player);
+
+void updateFlowField(FlowField& field, char** map, int maxRow, int maxCol, const Player& player);
+
+int flowDistance(const FlowField& field, int row, int col);
+
+#endif
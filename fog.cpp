@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cstring>
+#include "fog.h"
+
+// transforms from the octant shadowcasting walks into the map, one column per octant
+static const int OCTANT[4][8] = {
+    {1, 0, 0, -1, -1, 0, 0, 1},
+    {0, 1, -1, 0, 0, -1, 1, 0},
+    {0, 1, 1, 0, 0, -1, -1, 0},
+    {1, 0, 0, 1, -1, 0, 0, -1}
+};
+
+/**
+ * Forget what was seen; the radius is kept. Called when a new room is entered.
+ * @param   fog         Fog to clear.
+ * @updates fog
+ */
+void resetFog(FogOfWar& fog) {
+    fog.explored.clear();
+    fog.visible.clear();
+    fog.stamp = 0;
+    fog.map = nullptr;
+    fog.maxRow = 0;
+    fog.maxCol = 0;
+    fog.fromRow = -1;
+    fog.fromCol = -1;
+    fog.view.clear();
+    fog.viewRow = -1;
+    fog.viewCol = -1;
+}
+
+/**
+ * Move the fog onto a map that replaced its own. An amulet doubles the map and keeps the
+ * original in the top-left quadrant, and undoing it keeps that quadrant, so what was
+ * explored there stays explored; a map moved to a new allocation keeps everything. Any
+ * other map starts unexplored. Costs O(map), like the replacement itself.
+ * @param   fog         Fog of the old map, or a reset fog.
+ * @param   map         New map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @updates fog
+ */
+static void fitFog(FogOfWar& fog, char** map, int maxRow, int maxCol) {
+    std::vector<uint8_t> explored(static_cast<size_t>(maxRow) * maxCol, 0);
+    bool related = (maxRow == fog.maxRow && maxCol == fog.maxCol) || (maxRow == fog.maxRow * 2 && maxCol == fog.maxCol * 2)
+                   || (maxRow * 2 == fog.maxRow && maxCol * 2 == fog.maxCol);
+    if(related && fog.maxRow > 0){
+        int rows = std::min(maxRow, fog.maxRow);
+        int cols = std::min(maxCol, fog.maxCol);
+        for(int row = 0; row < rows; ++row){
+            std::memcpy(&explored[static_cast<size_t>(row) * maxCol], &fog.explored[static_cast<size_t>(row) * fog.maxCol], cols);
+        }
+    }
+    resetFog(fog);
+    fog.map = map;
+    fog.maxRow = maxRow;
+    fog.maxCol = maxCol;
+    fog.explored.swap(explored);
+    fog.visible.assign(static_cast<size_t>(maxRow) * maxCol, 0);
+}
+
+/**
+ * Mark a cell as in sight and explored.
+ * @updates fog
+ */
+static void reveal(FogOfWar& fog, int row, int col) {
+    size_t cell = static_cast<size_t>(row) * fog.maxCol + col;
+    fog.visible[cell] = fog.stamp;
+    fog.explored[cell] = 1;
+}
+
+/**
+ * Recursive shadowcasting over one octant: scan rows of growing distance from the player,
+ * narrowing the lit slope range [start, end] behind every pillar and recursing into the
+ * gaps between pillars. Only cells within the radius are ever touched.
+ * @param   fog         Fog being updated.
+ * @param   map         Dungeon map.
+ * @param   distance    Row of the octant to start at.
+ * @param   start       Upper slope still lit.
+ * @param   end         Lower slope still lit.
+ * @param   octant      Which of the eight octants to walk.
+ * @updates fog
+ */
+static void castLight(FogOfWar& fog, char** map, int distance, double start, double end, int octant) {
+    if(start < end){
+        return;
+    }
+    const int xx = OCTANT[0][octant];
+    const int xy = OCTANT[1][octant];
+    const int yx = OCTANT[2][octant];
+    const int yy = OCTANT[3][octant];
+    const int reach = fog.radius * fog.radius;
+    double nextStart = 0.0;
+    for(int i = distance; i <= fog.radius; ++i){
+        bool blocked = false;
+        int dy = -i;
+        for(int dx = -i; dx <= 0; ++dx){
+            double leftSlope = (dx - 0.5) / (dy + 0.5);
+            double rightSlope = (dx + 0.5) / (dy - 0.5);
+            if(start < rightSlope){
+                continue;
+            }
+            if(end > leftSlope){
+                break;
+            }
+            int row = fog.fromRow + dx * yx + dy * yy;
+            int col = fog.fromCol + dx * xx + dy * xy;
+            bool inside = row >= 0 && col >= 0 && row < fog.maxRow && col < fog.maxCol;
+            if(inside && dx * dx + dy * dy <= reach){
+                reveal(fog, row, col);
+            }
+            bool opaque = !inside || map[row][col] == TILE_PILLAR;
+            if(blocked){
+                if(opaque){
+                    nextStart = rightSlope;
+                    continue;
+                }
+                blocked = false;
+                start = nextStart;
+            } else if(opaque && i < fog.radius){
+                blocked = true;
+                castLight(fog, map, i + 1, start, leftSlope, octant);
+                nextStart = rightSlope;
+            }
+        }
+        if(blocked){
+            break;
+        }
+    }
+}
+
+/**
+ * Recompute what the player sees. Nothing is done while the player stands still; after a
+ * move only the cells within the radius are visited, and the previous sight is dropped in
+ * O(1) by moving to a new stamp, so the cost never depends on the size of the map.
+ * @param   fog         Fog of the session, with radius set.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   player      Player whose sight is cast.
+ * @updates fog
+ */
+void updateFog(FogOfWar& fog, char** map, int maxRow, int maxCol, const Player& player) {
+    if(fog.radius <= 0){
+        return;
+    }
+    if(fog.map != map || fog.maxRow != maxRow || fog.maxCol != maxCol){
+        fitFog(fog, map, maxRow, maxCol);
+    } else if(fog.fromRow == player.row && fog.fromCol == player.col){
+        return;
+    }
+    if(++fog.stamp == 0){
+        // the stamp wrapped: clear old marks once so none can match again
+        fog.visible.assign(fog.visible.size(), 0);
+        fog.stamp = 1;
+    }
+    fog.fromRow = player.row;
+    fog.fromCol = player.col;
+    reveal(fog, player.row, player.col);
+    for(int octant = 0; octant < 8; ++octant){
+        castLight(fog, map, 1, 1.0, 0.0, octant);
+    }
+}
+
+/**
+ * @param   fog         Updated fog.
+ * @param   row         Cell row.
+ * @param   col         Cell column.
+ * @return  true if the cell is in the player's sight right now.
+ */
+bool fogVisible(const FogOfWar& fog, int row, int col) {
+    return fog.stamp != 0 && fog.visible[static_cast<size_t>(row) * fog.maxCol + col] == fog.stamp;
+}
+
+/**
+ * @param   fog         Updated fog.
+ * @param   row         Cell row.
+ * @param   col         Cell column.
+ * @return  true if the player has ever seen the cell.
+ */
+bool fogExplored(const FogOfWar& fog, int row, int col) {
+    return fog.explored[static_cast<size_t>(row) * fog.maxCol + col] != 0;
+}
@@ -0,0 +1,39 @@
+#ifndef FOG_H
+#define FOG_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "logic.h"
+
+// shown for cells the player has never seen
+const char TILE_FOG = '#';
+
+// default sight radius of fog-of-war mode
+const int FOG_DEFAULT_RADIUS = 6;
+
+// what the player sees and has seen; radius 0 turns fog of war off
+struct FogOfWar {
+    int radius = 0;
+    std::vector<uint8_t> explored{};    // 1 for every cell ever seen, row-major
+    std::vector<uint32_t> visible{};    // equals stamp for the cells in sight right now
+    uint32_t stamp = 0;
+    char** map = nullptr;               // map the fog belongs to
+    int maxRow = 0;
+    int maxCol = 0;
+    int fromRow = -1;                   // player cell the sight was cast from
+    int fromCol = -1;
+    std::string view{};                 // last frame renderFogMap drew, empty until the next full render
+    int viewRow = -1;                   // player cell that frame was drawn around
+    int viewCol = -1;
+};
+
+// function signatures
+void resetFog(FogOfWar& fog);
+
+void updateFog(FogOfWar& fog, char** map, int maxRow, int maxCol, const Player& player);
+
+bool fogVisible(const FogOfWar& fog, int row, int col);
+
+bool fogExplored(const FogOfWar& fog, int row, int col);
+
+#endif
@@ -1,7 +1,14 @@
+#include <algorithm>
 #include <iostream>
+#include <vector>
+#include "alloc.h"
 #include "helper.h"
+#include "journal.h"
+#include "latency.h"
+#include "snapshot.h"
 using std::cout;
 using std::endl;
+using std::string;
 
 
 void printInstructions() {
@@ -14,83 +21,336 @@ void printInstructions() {
     cout << " $          : These are treasures. Lots of money!"         << endl;
     cout << " @          : These magical amulets resize the level."     << endl;
     cout << " M          : These are monsters; avoid them!"             << endl;
+    cout << " C          : These monsters chase you around walls!"      << endl;
+    cout << " F          : Fast monsters chase you two steps a turn!"   << endl;
+    cout << " Z          : Sleeping monsters wake when you come near."  << endl;
+    cout << " H          : These monsters prowl along the walls."       << endl;
     cout << " +, -, |    : These are unpassable obstacles."             << endl;
     cout << " ?          : A door to another level."                    << endl;
     cout << " !          : A door to escape the dungeon."               << endl;
     cout << " --- CONTROLS ---"                                         << endl;
     cout << " w, a, s, d : Keys for moving up, left, down, and right."  << endl;
     cout << " e          : Key for staying still for a turn."           << endl;
+    cout << " u, r       : Keys for undoing and redoing a move."        << endl;
+    cout << " p          : Key for saving your quest."                  << endl;
     cout << " q          : Key for abandoning your quest."              << endl;
     cout << "---------------------------------------------------------" << endl;
     cout << endl;
 }
 
-void outputMap(char** map, const int maxRow, const int maxCol) {
+void renderMap(std::string& out, char** map, const int maxRow, const int maxCol) {
     // output top border
-    cout << "+";
-    for (int i = 0; i < maxCol * DISPLAY_WIDTH; ++i) {
-        cout << "-";
-    }
-    cout << "+";
-    cout << endl;
-    
+    out += '+';
+    out.append(static_cast<size_t>(maxCol) * DISPLAY_WIDTH, '-');
+    out += "+\n";
+
     for (int i = 0; i < maxRow; ++i) {
         // output left border
-        cout << "|";
+        out += '|';
 
         // output inner blocks
         for (int j = 0; j < maxCol; ++j) {
             // output current block
-            cout << " ";
-            if (map[i][j] == TILE_OPEN) {
-                cout << " ";
-            } else {
-                cout << map[i][j];
-            }
-            cout << " ";
+            out += ' ';
+            out += map[i][j] == TILE_OPEN ? ' ' : map[i][j];
+            out += ' ';
         }
 
         // output right border
-        cout << "|";
-        cout << endl;
+        out += "|\n";
     }
-    
+
     // output bottom border
-    cout << "+";
-    for (int i = 0; i < maxCol * DISPLAY_WIDTH; ++i) {
-        cout << "-";
+    out += '+';
+    out.append(static_cast<size_t>(maxCol) * DISPLAY_WIDTH, '-');
+    out += "+\n";
+}
+
+/**
+ * @return  character a cell shows under fog of war: as it is in sight, only its pillar,
+ *          door or exit once explored, and fog before that.
+ */
+static char fogTile(char** map, const FogOfWar& fog, int row, int col) {
+    char tile = map[row][col];
+    if (!fogVisible(fog, row, col)) {
+        bool landmark = tile == TILE_PILLAR || tile == TILE_DOOR || tile == TILE_EXIT;
+        tile = !fogExplored(fog, row, col) ? TILE_FOG : (landmark ? tile : TILE_OPEN);
     }
-    cout << "+";
-    cout << endl;
+    return tile == TILE_OPEN ? ' ' : tile;
 }
 
-void outputStatus(const int status, const Player& player, int moves) {
+/**
+ * Redraw the cells within the sight radius of a cell in the fog's cached frame.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   fog         Fog holding the frame.
+ * @param   row         Center row.
+ * @param   col         Center column.
+ * @updates fog
+ */
+static void redrawAround(char** map, const int maxRow, const int maxCol, FogOfWar& fog, int row, int col) {
+    const size_t lineLength = static_cast<size_t>(maxCol) * DISPLAY_WIDTH + 3;
+    for (int i = std::max(0, row - fog.radius); i <= std::min(maxRow - 1, row + fog.radius); ++i) {
+        char* line = &fog.view[lineLength * (i + 1) + 1 + DISPLAY_WIDTH / 2];
+        for (int j = std::max(0, col - fog.radius); j <= std::min(maxCol - 1, col + fog.radius); ++j) {
+            line[j * DISPLAY_WIDTH] = fogTile(map, fog, i, j);
+        }
+    }
+}
+
+/**
+ * Render the map as the player remembers it under fog of war: cells in sight as they are,
+ * explored cells with only their pillars, doors and exits, and unexplored cells as fog.
+ * The frame is kept in the fog and drawn in full only after the map was replaced; other
+ * frames redraw just the cells within the radius of the player's last and current cell,
+ * the only ones whose sight can have changed, so the per-cell work is bounded by the radius
+ * and the rest is one copy of the cached text. Cells out of sight keep what the player last saw.
+ * @param   out         Text to show the player, appended to.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   fog         Fog updated to the player's cell.
+ * @updates out, fog
+ */
+void renderFogMap(std::string& out, char** map, const int maxRow, const int maxCol, FogOfWar& fog) {
+    if (fog.view.empty()) {
+        fog.view += '+';
+        fog.view.append(static_cast<size_t>(maxCol) * DISPLAY_WIDTH, '-');
+        fog.view += "+\n";
+        for (int i = 0; i < maxRow; ++i) {
+            fog.view += '|';
+            for (int j = 0; j < maxCol; ++j) {
+                fog.view += ' ';
+                fog.view += fogTile(map, fog, i, j);
+                fog.view += ' ';
+            }
+            fog.view += "|\n";
+        }
+        fog.view += '+';
+        fog.view.append(static_cast<size_t>(maxCol) * DISPLAY_WIDTH, '-');
+        fog.view += "+\n";
+    } else {
+        redrawAround(map, maxRow, maxCol, fog, fog.viewRow, fog.viewCol);
+        redrawAround(map, maxRow, maxCol, fog, fog.fromRow, fog.fromCol);
+    }
+    fog.viewRow = fog.fromRow;
+    fog.viewCol = fog.fromCol;
+    out += fog.view;
+}
+
+/**
+ * Render the session's map, through its fog of war if that is on.
+ * @param   out         Text to show the player, appended to.
+ * @param   session     Session to show.
+ * @updates out, session
+ */
+void renderView(std::string& out, GameSession& session) {
+    AllocationSite site(ALLOC_RENDER);
+    if (session.fog.radius <= 0) {
+        renderMap(out, session.map, session.maxRow, session.maxCol);
+        return;
+    }
+    updateFog(session.fog, session.map, session.maxRow, session.maxCol, session.player);
+    renderFogMap(out, session.map, session.maxRow, session.maxCol, session.fog);
+}
+
+void outputMap(char** map, const int maxRow, const int maxCol) {
+    string frame;
+    renderMap(frame, map, maxRow, maxCol);
+    cout << frame << std::flush;
+}
+
+void renderStatus(std::string& out, const int status, const Player& player, int moves) {
     if (status != STATUS_STAY) {
-        cout << "You have moved to row " << player.row << " and column " << player.col << endl;
+        out += "You have moved to row " + std::to_string(player.row) + " and column " + std::to_string(player.col) + "\n";
     }
     switch (status) {
         case STATUS_STAY :
-			cout << "You stayed at row " << player.row << " and column " << player.col << endl;
-            cout << "You didn't move. Are you lost?" << endl;
+            out += "You stayed at row " + std::to_string(player.row) + " and column " + std::to_string(player.col) + "\n";
+            out += "You didn't move. Are you lost?\n";
             break;
         case STATUS_MOVE :
             break;
         case STATUS_TREASURE :
-            cout << "Well done, adventurer! You found some treasure." << endl;
-            cout << "You now have " << player.treasure << (player.treasure > 1 ? " treasures." : " treasure.") << endl;
+            out += "Well done, adventurer! You found some treasure.\n";
+            out += "You now have " + std::to_string(player.treasure) + (player.treasure > 1 ? " treasures." : " treasure.") + "\n";
             break;
         case STATUS_AMULET :
-            cout << "The magic amulet sparkles and crumbles into dust." << endl;
-            cout << "The ground begins to rumble. Are the walls moving?" << endl;
+            out += "The magic amulet sparkles and crumbles into dust.\n";
+            out += "The ground begins to rumble. Are the walls moving?\n";
             break;
         case STATUS_LEAVE :
-            cout << "You go through the doorway into the unknown beyond..." << endl;
+            out += "You go through the doorway into the unknown beyond...\n";
             break;
         case STATUS_ESCAPE :
-            cout << "Congratulations, adventurer! You have escaped the dungeon!" << endl;
-            cout << "You escaped with " << player.treasure << (player.treasure > 1 ? " treasures " : " treasure ");
-            cout << "and in " << moves << " total moves." << endl;
+            out += "Congratulations, adventurer! You have escaped the dungeon!\n";
+            out += "You escaped with " + std::to_string(player.treasure) + (player.treasure > 1 ? " treasures " : " treasure ");
+            out += "and in " + std::to_string(moves) + " total moves.\n";
             break;
     }
-    cout << endl;
+    out += '\n';
+}
+
+void outputStatus(const int status, const Player& player, int moves) {
+    string text;
+    renderStatus(text, status, player, moves);
+    cout << text << std::flush;
+}
+
+/**
+ * Report how much memory the game held, for the summary at its end.
+ * @param   out         Text to show the player, appended to.
+ * @param   session     Session that ended.
+ * @updates out
+ */
+void renderFootprint(std::string& out, const GameSession& session) {
+    SessionFootprint footprint = sessionFootprint(session);
+    out += "Memory: map " + std::to_string(footprint.mapBytes) + " bytes (peak " + std::to_string(session.peakMapBytes) + "), ";
+    out += "level " + std::to_string(footprint.levelBytes) + ", indexes " + std::to_string(footprint.indexBytes);
+    out += ", journal " + std::to_string(footprint.journalBytes) + ", total " + std::to_string(footprint.totalBytes);
+    out += " bytes (peak " + std::to_string(session.peakBytes) + ")\n";
+}
+
+/**
+ * Explain why the last room could not be loaded, as loadLevel does on the console.
+ * @param   out         Text to show the player, appended to.
+ * @param   session     Session whose room load failed.
+ * @updates out
+ */
+static void renderLoadError(string& out, const GameSession& session) {
+    if (session.loadError == LEVEL_NOT_OPEN) {
+        out += "FILE NOT OPEN\n";
+    }
+}
+
+/**
+ * Start a game and render what the player sees first.
+ * @param   session     Session to start.
+ * @param   dungeon     Dungeon name.
+ * @param   totalRooms  Number of rooms in the dungeon.
+ * @param   out         Text to show the player, appended to.
+ * @return  GAME_RUNNING, or the exit code if the first room could not be loaded.
+ * @updates session, out
+ */
+int beginGame(GameSession& session, const string& dungeon, int totalRooms, string& out) {
+    out += "Level 1\n";
+    if (!startSession(session, dungeon, totalRooms)) {
+        renderLoadError(out, session);
+        out += "Returning you back to the real word, adventurer!\n";
+        return 1;
+    }
+    renderView(out, session);
+    return GAME_RUNNING;
+}
+
+/**
+ * Resume a saved game and render what the player sees first.
+ * @param   session     Session to restore.
+ * @param   fileName    Save file written by the save command.
+ * @param   out         Text to show the player, appended to.
+ * @return  GAME_RUNNING, or the exit code if the save could not be loaded.
+ * @updates session, out
+ */
+int resumeGame(GameSession& session, const string& fileName, string& out) {
+    if (!loadSession(fileName, session)) {
+        out += "Your saved quest could not be found, adventurer!\n";
+        return 1;
+    }
+    out += "Level " + std::to_string(session.current_room) + "\n";
+    renderView(out, session);
+    return GAME_RUNNING;
+}
+
+/**
+ * Play one command and render the resulting frame, exactly as the console game shows it.
+ * @param   session     Session to advance.
+ * @param   input       Command character.
+ * @param   out         Text to show the player, appended to.
+ * @return  GAME_RUNNING while the game goes on, otherwise the exit code of the game.
+ * @updates session, out
+ */
+int playTurn(GameSession& session, char input, string& out) {
+    // save without spending a move
+    if (input == INPUT_SAVE) {
+        static thread_local std::vector<char> buffer;
+        string fileName = saveFileName(session);
+        if (saveSession(session, fileName, buffer)) {
+            out += "Your quest has been saved to " + fileName + ".\n";
+        } else {
+            out += "Your quest could not be saved, adventurer!\n";
+        }
+        return GAME_RUNNING;
+    }
+
+    // walk the undo history
+    if (input == INPUT_UNDO || input == INPUT_REDO) {
+        bool undo = input == INPUT_UNDO;
+        bool walked = session.journal != nullptr
+                      && (undo ? undoTurn(*session.journal, session) : redoTurn(*session.journal, session));
+        if (!walked) {
+            out += undo ? "There is nothing to undo, adventurer!\n" : "There is nothing to redo, adventurer!\n";
+            return GAME_RUNNING;
+        }
+        renderView(out, session);
+        out += undo ? "You retrace your steps...\n" : "You walk the same steps again...\n";
+        out += "You are at row " + std::to_string(session.player.row) + " and column " + std::to_string(session.player.col) + "\n\n";
+        return GAME_RUNNING;
+    }
+
+    // the turn's latency runs until its frame is rendered
+    TurnTimer turnTimer(session.profiler);
+    int turn = stepSession(session, input);
+    PhaseTimer renderTimer(session.profiler, PHASE_RENDER);
+
+    // quit game if user inputs quit
+    if (turn == TURN_QUIT) {
+        out += "Thank you for playing!\n";
+        return 0;
+    }
+
+    // reprompt if invalid command
+    if (turn == TURN_INVALID) {
+        out += "I did not understand your command, adventurer!\n";
+        return GAME_RUNNING;
+    }
+
+    // amulet made the map too big to hold
+    if (turn == TURN_ERROR) {
+        out += "Returning you back to the real word, adventurer!\n";
+        return 1;
+    }
+
+    renderView(out, session);
+
+    // end if player is caught
+    if (turn == TURN_DIED) {
+        out += "You died, adventurer! Better luck next time!\n";
+        renderFootprint(out, session);
+        return 0;
+    }
+
+    renderStatus(out, session.status, session.player, session.total_moves);
+
+    // quit game if user escapes
+    if (turn == TURN_ESCAPE) {
+        renderFootprint(out, session);
+        return 0;
+    }
+
+    // go to next level if user goes through door
+    if (turn == TURN_LEAVE) {
+        if (!hasNextRoom(session)) {
+            renderFootprint(out, session);
+            return 0;
+        }
+        out += "Level " + std::to_string(session.current_room + 1) + "\n";
+        if (!enterRoom(session, session.current_room + 1)) {
+            renderLoadError(out, session);
+            out += "Returning you back to the real word, adventurer!\n";
+            return 1;
+        }
+        renderView(out, session);
+    }
+    return GAME_RUNNING;
 }
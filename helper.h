@@ -1,16 +1,41 @@
 #ifndef HELPER_H
 #define HELPER_H
+#include <string>
+#include "fog.h"
 #include "logic.h"
+#include "session.h"
 
 // constant value for tile width in console output
 const int DISPLAY_WIDTH = 3;
 
+// returned by beginGame and playTurn while the game goes on; anything else is the exit code
+const int GAME_RUNNING = -1;
+
+// prompt shown before every command
+const char COMMAND_PROMPT[] = "Enter command (w,a,s,d: move, e: stay still, q: quit): ";
+
 
 // function signatures
 void printInstructions();
 
+void renderMap(std::string& out, char** board, const int maxRow, const int maxCol);
+
+void renderFogMap(std::string& out, char** map, const int maxRow, const int maxCol, FogOfWar& fog);
+
+void renderView(std::string& out, GameSession& session);
+
 void outputMap(char** board, const int maxRow, const int maxCol);
 
+void renderStatus(std::string& out, const int status, const Player& player, int moves);
+
 void outputStatus(const int status, const Player& player, int moves);
 
+void renderFootprint(std::string& out, const GameSession& session);
+
+int beginGame(GameSession& session, const std::string& dungeon, int totalRooms, std::string& out);
+
+int resumeGame(GameSession& session, const std::string& fileName, std::string& out);
+
+int playTurn(GameSession& session, char input, std::string& out);
+
 #endif
@@ -0,0 +1,448 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include "journal.h"
+
+Journal::~Journal() {
+    clearJournal(*this);
+}
+
+/**
+ * Free the map a turn keeps for undo, and the headings of its huggers.
+ * @param   journal     Journal holding the turn.
+ * @param   turn        Turn whose map is freed.
+ * @updates journal, turn
+ */
+static void freeOtherMap(Journal& journal, TurnRecord& turn) {
+    if(turn.otherMap != nullptr){
+        journal.mapBytes -= mapBytes(turn.otherRows, turn.otherCols) + turn.priorHeadings.capacity() * sizeof(MonsterHeading);
+    }
+    deleteMap(turn.otherMap, turn.otherRows);
+    std::vector<MonsterHeading>().swap(turn.priorHeadings);
+}
+
+/**
+ * Drop the redo history from the cursor on, freeing the grown maps it kept.
+ * @param   journal     Journal to trim.
+ * @updates journal
+ */
+static void dropRedo(Journal& journal) {
+    for(size_t i = journal.cursor; i < journal.turns.size(); ++i){
+        freeOtherMap(journal, journal.turns[i]);
+    }
+    if(journal.cursor < journal.turns.size()){
+        journal.changes.resize(journal.turns[journal.cursor].firstChange);
+        journal.turns.resize(journal.cursor);
+    }
+}
+
+/**
+ * Forget the oldest turn, so a capped journal stays within maxTurns. Costs O(turns kept),
+ * which the cap bounds.
+ * @param   journal     Journal with at least one turn before the cursor.
+ * @updates journal
+ */
+static void dropOldest(Journal& journal) {
+    TurnRecord& oldest = journal.turns.front();
+    freeOtherMap(journal, oldest);
+    size_t dropped = oldest.changeCount;
+    journal.changes.erase(journal.changes.begin(), journal.changes.begin() + static_cast<std::ptrdiff_t>(dropped));
+    journal.turns.erase(journal.turns.begin());
+    for(TurnRecord& turn : journal.turns){
+        turn.firstChange -= dropped;
+    }
+    journal.cursor--;
+}
+
+/**
+ * Forget every turn and free the maps kept for them; used when a new room is entered.
+ * @param   journal     Journal to clear.
+ * @updates journal
+ */
+void clearJournal(Journal& journal) {
+    for(TurnRecord& turn : journal.turns){
+        deleteMap(turn.otherMap, turn.otherRows);
+    }
+    journal.mapBytes = 0;
+    journal.turns.clear();
+    journal.changes.clear();
+    journal.cursor = 0;
+    journal.recording = false;
+}
+
+/**
+ * @param   journal     Journal to measure.
+ * @return  bytes of its records, changes and the maps it keeps for undo, in O(1).
+ */
+size_t journalBytes(const Journal& journal) {
+    return journal.turns.capacity() * sizeof(TurnRecord) + journal.changes.capacity() * sizeof(CellChange)
+           + journal.headings.capacity() * sizeof(MonsterHeading) + journal.mapBytes;
+}
+
+/**
+ * Open a record for the turn about to be played. A new turn ends the redo history, and
+ * in a capped journal pushes the oldest turn out.
+ * @param   journal     Journal of the session.
+ * @param   session     Session before the turn.
+ * @updates journal
+ */
+void beginTurn(Journal& journal, const GameSession& session) {
+    dropRedo(journal);
+    if(journal.maxTurns > 0 && journal.turns.size() >= journal.maxTurns){
+        dropOldest(journal);
+    }
+    TurnRecord turn;
+    turn.firstChange = journal.changes.size();
+    turn.playerBefore = session.player;
+    turn.movesBefore = session.total_moves;
+    turn.statusBefore = session.status;
+    journal.turns.push_back(turn);
+    collectHeadings(session.monsters, session.map, session.maxRow, session.maxCol, journal.headings);
+    journal.recording = true;
+}
+
+/**
+ * Remember a cell's value before the turn touches it. A cell may be captured more than once
+ * in a turn; endTurn keeps only its first capture, whose before value is the value at the
+ * start of the turn, so a hugger's heading is looked up among the headings the turn began
+ * with. Appending without a lookup keeps turns that move many monsters cheap.
+ * @param   journal     Journal with an open turn.
+ * @param   map         Dungeon map.
+ * @param   row         Cell row.
+ * @param   col         Cell column.
+ * @updates journal
+ */
+void recordCell(Journal& journal, char** map, int row, int col) {
+    CellChange change;
+    change.row = row;
+    change.col = col;
+    change.before = map[row][col];
+    change.headingBefore = change.before == TILE_HUGGER ? headingAt(journal.headings, row, col) : 0;
+    journal.changes.push_back(change);
+}
+
+/**
+ * Capture the cells doPlayerMove may change: the player's cell and the target cell.
+ * @param   journal     Journal with an open turn.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   player      Player before the move.
+ * @param   nextRow     Player's next row on the dungeon map (up/down).
+ * @param   nextCol     Player's next column on dungeon map (left/right).
+ * @updates journal
+ */
+void recordPlayerMove(Journal& journal, char** map, int maxRow, int maxCol, const Player& player, int nextRow, int nextCol) {
+    recordCell(journal, map, player.row, player.col);
+    if(nextRow >= 0 && nextCol >= 0 && nextRow < maxRow && nextCol < maxCol){
+        recordCell(journal, map, nextRow, nextCol);
+    }
+}
+
+/**
+ * Capture the cells doMonsterAttack may change: every monster in line of sight of the
+ * player and the cell it steps onto. Walks the same four rays doMonsterAttack walks.
+ * @param   journal     Journal with an open turn.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   player      Player, after the move.
+ * @updates journal
+ */
+void recordMonsterAttack(Journal& journal, char** map, int maxRow, int maxCol, const Player& player) {
+    const int stepRow[4] = {-1, 1, 0, 0};
+    const int stepCol[4] = {0, 0, 1, -1};
+    for(int ray = 0; ray < 4; ++ray){
+        int row = player.row + stepRow[ray];
+        int col = player.col + stepCol[ray];
+        while(row >= 0 && col >= 0 && row < maxRow && col < maxCol && map[row][col] != TILE_PILLAR){
+            if(map[row][col] == TILE_MONSTER){
+                recordCell(journal, map, row, col);
+                recordCell(journal, map, row - stepRow[ray], col - stepCol[ray]);
+            }
+            row += stepRow[ray];
+            col += stepCol[ray];
+        }
+    }
+}
+
+/**
+ * Double the map the way resizeMap does, but leave the original map alone so the
+ * journal can keep it for undo.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @return  new map of twice the size, or nullptr if it would be too large.
+ */
+char** growMap(char** map, int maxRow, int maxCol) {
+    if(map == nullptr || maxRow <= 0 || maxCol <= 0 || maxRow * 2 > (INT32_MAX / (maxCol * 2))){
+        return nullptr;
+    }
+    char** grown = createMap(maxRow * 2, maxCol * 2);
+    for(int row = 0; row < maxRow; ++row){
+        char* top = grown[row];
+        char* bottom = grown[row + maxRow];
+        std::memcpy(top, map[row], maxCol);
+        std::memcpy(top + maxCol, map[row], maxCol);
+        std::memcpy(bottom, map[row], maxCol);
+        std::memcpy(bottom + maxCol, map[row], maxCol);
+        for(int col = 0; col < maxCol; ++col){
+            // only the original quadrant keeps the player
+            if(map[row][col] == TILE_PLAYER){
+                top[col + maxCol] = TILE_OPEN;
+                bottom[col] = TILE_OPEN;
+                bottom[col + maxCol] = TILE_OPEN;
+            }
+        }
+    }
+    return grown;
+}
+
+/**
+ * Keep the map an amulet replaced, so undo can put it back.
+ * @param   journal     Journal with an open turn.
+ * @param   priorMap    Map before the resize; the journal takes ownership.
+ * @param   priorRows   Its number of rows.
+ * @param   priorCols   Its number of columns.
+ * @updates journal
+ */
+void recordResize(Journal& journal, char** priorMap, int priorRows, int priorCols) {
+    TurnRecord& turn = journal.turns.back();
+    turn.otherMap = priorMap;
+    turn.otherRows = priorRows;
+    turn.otherCols = priorCols;
+    journal.mapBytes += mapBytes(priorRows, priorCols);
+}
+
+/**
+ * Merge repeated captures of a cell into its first one, whose before value is the value at
+ * the start of the range, read the after value, and hugger heading, of every captured cell
+ * and drop the ones that did not change.
+ * @param   journal     Journal holding the captures.
+ * @param   first       Index of the first capture of the range, which runs to the end.
+ * @param   played      Map the captured cells belong to.
+ * @param   rows        Its number of rows.
+ * @param   cols        Its number of columns.
+ * @param   monsters    Monster list after the range.
+ * @return  new end of the changes.
+ * @updates journal
+ */
+static size_t mergeChanges(Journal& journal, size_t first, char** played, int rows, int cols, const MonsterList& monsters) {
+    static thread_local std::vector<MonsterHeading> headings;
+    bool collected = false;
+    std::stable_sort(journal.changes.begin() + static_cast<std::ptrdiff_t>(first), journal.changes.end(),
+                     [](const CellChange& a, const CellChange& b){
+        return a.row != b.row ? a.row < b.row : a.col < b.col;
+    });
+    size_t kept = first;
+    for(size_t i = first; i < journal.changes.size(); ++i){
+        CellChange change = journal.changes[i];
+        if(i > first && change.row == journal.changes[i - 1].row && change.col == journal.changes[i - 1].col){
+            continue;
+        }
+        change.after = played[change.row][change.col];
+        if(change.after == TILE_HUGGER && !collected){
+            collectHeadings(monsters, played, rows, cols, headings);
+            collected = true;
+        }
+        change.headingAfter = change.after == TILE_HUGGER ? headingAt(headings, change.row, change.col) : 0;
+        if(change.after != change.before || change.headingAfter != change.headingBefore){
+            journal.changes[kept++] = change;
+        }
+    }
+    journal.changes.resize(kept);
+    return kept;
+}
+
+/**
+ * Close the open turn: merge repeated captures of a cell into its first one, read the
+ * after value of every captured cell and drop the ones that did not change, so the record
+ * holds only real deltas.
+ * @param   journal     Journal with an open turn.
+ * @param   session     Session after the turn.
+ * @updates journal
+ */
+void endTurn(Journal& journal, const GameSession& session) {
+    if(!journal.recording){
+        return;
+    }
+    TurnRecord& turn = journal.turns.back();
+    // cells belong to the map the turn was played on, which is the prior map if an amulet was used
+    char** played = session.map;
+    int rows = session.maxRow;
+    int cols = session.maxCol;
+    if(turn.otherMap != nullptr){
+        played = turn.otherMap;
+        rows = turn.otherRows;
+        cols = turn.otherCols;
+        collectHeadings(session.monsters, played, rows, cols, turn.priorHeadings);
+        journal.mapBytes += turn.priorHeadings.capacity() * sizeof(MonsterHeading);
+    }
+    turn.changeCount = mergeChanges(journal, turn.firstChange, played, rows, cols, session.monsters) - turn.firstChange;
+    turn.playerAfter = session.player;
+    turn.movesAfter = session.total_moves;
+    turn.statusAfter = session.status;
+    journal.cursor = journal.turns.size();
+    journal.recording = false;
+}
+
+/**
+ * Start capturing the cells of a tick in which only the monsters move. No record is opened
+ * yet, so a tick that changes nothing leaves the journal, and its redo history, as it was.
+ * @param   journal     Journal of the session.
+ * @param   session     Session before the tick.
+ * @return  where the tick's captures start, for endIdleTick.
+ * @updates journal
+ */
+size_t beginIdleTick(Journal& journal, const GameSession& session) {
+    collectHeadings(session.monsters, session.map, session.maxRow, session.maxCol, journal.headings);
+    journal.recording = true;
+    return journal.changes.size();
+}
+
+/**
+ * Close an idle tick. A tick that changed no cell is forgotten. Otherwise it is folded into
+ * the last turn when that turn is the newest and kept its map, so undo takes back a command
+ * together with the monster moves of the ticks after it and the journal grows with commands,
+ * not with ticks; in any other case the tick ends the redo history and gets a record of its own.
+ * @param   journal     Journal of the session.
+ * @param   session     Session after the tick.
+ * @param   mark        Value beginIdleTick returned.
+ * @updates journal
+ */
+void endIdleTick(Journal& journal, const GameSession& session, size_t mark) {
+    journal.recording = false;
+    size_t kept = mergeChanges(journal, mark, session.map, session.maxRow, session.maxCol, session.monsters);
+    if(kept == mark){
+        return;
+    }
+    if(journal.cursor > 0 && journal.cursor == journal.turns.size() && journal.turns.back().otherMap == nullptr){
+        TurnRecord& turn = journal.turns.back();
+        turn.changeCount = mergeChanges(journal, turn.firstChange, session.map, session.maxRow, session.maxCol, session.monsters)
+                           - turn.firstChange;
+        turn.playerAfter = session.player;
+        turn.movesAfter = session.total_moves;
+        turn.statusAfter = session.status;
+        return;
+    }
+
+    // the redo records sit between the last turn and the tick's captures
+    std::vector<CellChange> tick(journal.changes.begin() + static_cast<std::ptrdiff_t>(mark), journal.changes.end());
+    journal.changes.resize(mark);
+    dropRedo(journal);
+    if(journal.maxTurns > 0 && journal.turns.size() >= journal.maxTurns){
+        dropOldest(journal);
+    }
+    TurnRecord turn;
+    turn.firstChange = journal.changes.size();
+    turn.changeCount = tick.size();
+    turn.playerBefore = turn.playerAfter = session.player;
+    turn.movesBefore = turn.movesAfter = session.total_moves;
+    turn.statusBefore = turn.statusAfter = session.status;
+    journal.changes.insert(journal.changes.end(), tick.begin(), tick.end());
+    journal.turns.push_back(turn);
+    journal.cursor = journal.turns.size();
+}
+
+/**
+ * Swap the live map with the one kept in a turn record.
+ * @param   journal     Journal holding the record.
+ * @param   turn        Record holding the other map.
+ * @param   session     Session whose map is swapped.
+ * @updates journal, turn, session
+ */
+static void swapMaps(Journal& journal, TurnRecord& turn, GameSession& session) {
+    journal.mapBytes += mapBytes(session.maxRow, session.maxCol) - mapBytes(turn.otherRows, turn.otherCols);
+    char** map = session.map;
+    int rows = session.maxRow;
+    int cols = session.maxCol;
+    session.map = turn.otherMap;
+    session.maxRow = turn.otherRows;
+    session.maxCol = turn.otherCols;
+    turn.otherMap = map;
+    turn.otherRows = rows;
+    turn.otherCols = cols;
+}
+
+/**
+ * Re-index the cells a turn rewrote in the spatial grid and the monster list. A grid or list
+ * built for the other map of a resize is left alone; it is rebuilt on the next turn.
+ * @param   journal     Journal holding the turn.
+ * @param   turn        Turn just undone or redone.
+ * @param   session     Session after the rewrite.
+ * @param   undone      true for undo, false for redo.
+ * @updates session
+ */
+static void reindexTurn(const Journal& journal, const TurnRecord& turn, GameSession& session, bool undone) {
+    const CellChange* changes = journal.changes.data() + turn.firstChange;
+    SpatialGrid& grid = session.entities;
+    if(grid.map == session.map && grid.maxRow == session.maxRow && grid.maxCol == session.maxCol){
+        for(size_t i = 0; i < turn.changeCount; ++i){
+            removeEntity(grid, changes[i].row, changes[i].col);
+            if(isIndexedTile(session.map[changes[i].row][changes[i].col])){
+                addEntity(grid, changes[i].row, changes[i].col);
+            }
+        }
+    }
+    if(session.monsters.maxRow == session.maxRow && session.monsters.maxCol == session.maxCol){
+        applyCellChanges(session.monsters, session.map, changes, turn.changeCount, undone);
+    }
+}
+
+/**
+ * Take back the last played turn. Costs O(cells the turn changed) plus a pass over the
+ * listed monsters; the spatial grid and the monster list are updated from the same deltas,
+ * and huggers get back the headings they had. Taking back an amulet rebuilds the monster
+ * list of the restored map, with the headings the turn left its huggers in.
+ * @param   journal     Journal of the session.
+ * @param   session     Session to rewind.
+ * @return  false if there is nothing to undo.
+ * @updates journal, session
+ */
+bool undoTurn(Journal& journal, GameSession& session) {
+    if(journal.cursor == 0){
+        return false;
+    }
+    TurnRecord& turn = journal.turns[--journal.cursor];
+    if(turn.otherMap != nullptr){
+        swapMaps(journal, turn, session);
+        // the map is back as the turn left it, and so are its huggers
+        restoreHeadings(session.monsters, session.map, session.maxRow, session.maxCol, turn.priorHeadings);
+    }
+    for(size_t i = turn.firstChange + turn.changeCount; i > turn.firstChange; --i){
+        const CellChange& change = journal.changes[i - 1];
+        session.map[change.row][change.col] = change.before;
+    }
+    session.player = turn.playerBefore;
+    session.total_moves = turn.movesBefore;
+    session.status = turn.statusBefore;
+    reindexTurn(journal, turn, session, true);
+    return true;
+}
+
+/**
+ * Play an undone turn again. Costs O(cells the turn changed) plus a pass over the listed
+ * monsters; the spatial grid and the monster list are updated from the same deltas.
+ * @param   journal     Journal of the session.
+ * @param   session     Session to advance.
+ * @return  false if there is nothing to redo.
+ * @updates journal, session
+ */
+bool redoTurn(Journal& journal, GameSession& session) {
+    if(journal.cursor == journal.turns.size()){
+        return false;
+    }
+    TurnRecord& turn = journal.turns[journal.cursor++];
+    for(size_t i = turn.firstChange; i < turn.firstChange + turn.changeCount; ++i){
+        const CellChange& change = journal.changes[i];
+        session.map[change.row][change.col] = change.after;
+    }
+    if(turn.otherMap != nullptr){
+        swapMaps(journal, turn, session);
+    }
+    session.player = turn.playerAfter;
+    session.total_moves = turn.movesAfter;
+    session.status = turn.statusAfter;
+    reindexTurn(journal, turn, session, false);
+    return true;
+}
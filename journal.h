@@ -0,0 +1,81 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "session.h"
+
+// commands that walk the journal
+const char INPUT_UNDO = 'u';
+const char INPUT_REDO = 'r';
+
+// one map cell a turn changed
+struct CellChange {
+    int row = 0;
+    int col = 0;
+    char before = 0;
+    char after = 0;
+    uint8_t headingBefore = 0;  // heading of the hugger on the cell, if any
+    uint8_t headingAfter = 0;
+};
+
+// everything needed to take one turn back or play it again
+struct TurnRecord {
+    size_t firstChange = 0;     // index into Journal::changes
+    size_t changeCount = 0;
+    Player playerBefore{};
+    Player playerAfter{};
+    int movesBefore = 0;
+    int movesAfter = 0;
+    int statusBefore = 0;
+    int statusAfter = 0;
+    char** otherMap = nullptr;  // set if an amulet replaced the map: whichever of the two maps is not live
+    int otherRows = 0;
+    int otherCols = 0;
+    std::vector<MonsterHeading> priorHeadings{};    // huggers of the map an amulet replaced, as the turn left them
+};
+
+// undo history of the current room: turns before cursor can be undone, turns from cursor on redone
+struct Journal {
+    std::vector<TurnRecord> turns{};
+    std::vector<CellChange> changes{};
+    size_t cursor = 0;
+    bool recording = false;
+    std::vector<MonsterHeading> headings{};    // huggers' headings when the open turn or tick began
+    size_t maxTurns = 0;        // oldest turns are forgotten beyond this many, 0 keeps every turn of the room
+    size_t mapBytes = 0;        // bytes of the maps, and of their huggers' headings, the turns keep for undo
+
+    Journal() = default;
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+};
+
+// function signatures
+void clearJournal(Journal& journal);
+
+size_t journalBytes(const Journal& journal);
+
+void beginTurn(Journal& journal, const GameSession& session);
+
+void recordCell(Journal& journal, char** map, int row, int col);
+
+void recordPlayerMove(Journal& journal, char** map, int maxRow, int maxCol, const Player& player, int nextRow, int nextCol);
+
+void recordMonsterAttack(Journal& journal, char** map, int maxRow, int maxCol, const Player& player);
+
+char** growMap(char** map, int maxRow, int maxCol);
+
+void recordResize(Journal& journal, char** priorMap, int priorRows, int priorCols);
+
+void endTurn(Journal& journal, const GameSession& session);
+
+size_t beginIdleTick(Journal& journal, const GameSession& session);
+
+void endIdleTick(Journal& journal, const GameSession& session, size_t mark);
+
+bool undoTurn(Journal& journal, GameSession& session);
+
+bool redoTurn(Journal& journal, GameSession& session);
+
+#endif
@@ -0,0 +1,194 @@
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include "latency.h"
+#include "metrics.h"
+#include "trace.h"
+
+using std::string;
+
+// names of the phases in reports, indexed by PHASE_*
+static const char* PHASE_NAME[PHASE_COUNT] = {"input", "move", "monsters", "resize", "render"};
+
+// nesting of TurnTimer on this thread, so only the outermost one records
+static thread_local int turnDepth = 0;
+
+// set by SIGUSR1, cleared when the report is printed
+static volatile std::sig_atomic_t reportWanted = 0;
+
+/**
+ * @return  nanoseconds on the monotonic clock.
+ */
+uint64_t monotonicNanos() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+PhaseTimer::PhaseTimer(TurnProfiler* profiler, int phase)
+    : profiler(profiler), phase(phase), start(profiler != nullptr || tracing() ? monotonicNanos() : 0) {
+}
+
+PhaseTimer::~PhaseTimer() {
+    if(start == 0){
+        return;
+    }
+    uint64_t end = monotonicNanos();
+    if(profiler != nullptr){
+        recordLatency(profiler->phases[phase], end - start);
+    }
+    traceEvent(PHASE_NAME[phase], start, end);
+}
+
+TurnTimer::TurnTimer(TurnProfiler* profiler)
+    : profiler(profiler), start(0) {
+    if(turnDepth++ == 0 && (profiler != nullptr || tracing() || collectingMetrics())){
+        start = monotonicNanos();
+    }
+}
+
+TurnTimer::~TurnTimer() {
+    turnDepth--;
+    if(start == 0){
+        return;
+    }
+    uint64_t end = monotonicNanos();
+    if(profiler != nullptr){
+        recordLatency(profiler->turns, end - start);
+    }
+    traceEvent("turn", start, end);
+    if(collectingMetrics()){
+        recordTurnMetric(end - start);
+    }
+}
+
+/**
+ * Bucket of a value: exact below 2^HISTOGRAM_SUB_BITS, then 2^HISTOGRAM_SUB_BITS equal
+ * buckets per power of two, so every bucket is narrower than 1% of the values it holds.
+ * @param   nanos       Value to place.
+ * @return  bucket index.
+ */
+int latencyBucket(uint64_t nanos) {
+    const uint64_t largest = (1ULL << (HISTOGRAM_MAX_BITS + 1)) - 1;
+    if(nanos > largest){
+        nanos = largest;
+    }
+    if(nanos < (1ULL << HISTOGRAM_SUB_BITS)){
+        return static_cast<int>(nanos);
+    }
+    int magnitude = 63 - __builtin_clzll(nanos);
+    int shift = magnitude - HISTOGRAM_SUB_BITS;
+    int sub = static_cast<int>(nanos >> shift) - (1 << HISTOGRAM_SUB_BITS);
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+/**
+ * @param   bucket      Bucket index.
+ * @return  largest value the bucket holds.
+ */
+uint64_t latencyBucketTop(int bucket) {
+    if(bucket < (1 << HISTOGRAM_SUB_BITS)){
+        return static_cast<uint64_t>(bucket);
+    }
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = static_cast<uint64_t>(bucket & ((1 << HISTOGRAM_SUB_BITS) - 1));
+    return (((1ULL << HISTOGRAM_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+/**
+ * Count one latency.
+ * @param   histogram   Histogram to update.
+ * @param   nanos       Latency in nanoseconds.
+ * @updates histogram
+ */
+void recordLatency(LatencyHistogram& histogram, uint64_t nanos) {
+    histogram.counts[latencyBucket(nanos)]++;
+    histogram.total++;
+    histogram.sum += nanos;
+    histogram.max = nanos > histogram.max ? nanos : histogram.max;
+}
+
+/**
+ * @param   histogram   Histogram to read.
+ * @param   percentile  Percentile, 0 to 100.
+ * @return  latency at or below which the given share of the values fall, rounded up to
+ *          the top of its bucket; 0 for an empty histogram.
+ */
+uint64_t latencyPercentile(const LatencyHistogram& histogram, double percentile) {
+    if(histogram.total == 0){
+        return 0;
+    }
+    uint64_t wanted = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(histogram.total) + 0.5);
+    wanted = wanted == 0 ? 1 : wanted;
+    uint64_t seen = 0;
+    for(int bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket){
+        seen += histogram.counts[bucket];
+        if(seen >= wanted){
+            uint64_t top = latencyBucketTop(bucket);
+            return top < histogram.max ? top : histogram.max;
+        }
+    }
+    return histogram.max;
+}
+
+/**
+ * Append one line of the report.
+ * @updates out
+ */
+static void renderLine(string& out, const char* name, const LatencyHistogram& histogram) {
+    char line[160];
+    double mean = histogram.total == 0 ? 0.0 : static_cast<double>(histogram.sum) / static_cast<double>(histogram.total);
+    std::snprintf(line, sizeof(line), "%-10s %10llu %10.2f %10.2f %10.2f %10.2f %10.2f\n", name,
+                  static_cast<unsigned long long>(histogram.total), mean / 1000.0,
+                  static_cast<double>(latencyPercentile(histogram, 50.0)) / 1000.0,
+                  static_cast<double>(latencyPercentile(histogram, 99.0)) / 1000.0,
+                  static_cast<double>(latencyPercentile(histogram, 99.9)) / 1000.0,
+                  static_cast<double>(histogram.max) / 1000.0);
+    out += line;
+}
+
+/**
+ * Render the latency report: whole turns, then each phase, in microseconds.
+ * @param   out         Text to print, appended to.
+ * @param   profiler    Profiler of the game.
+ * @updates out
+ */
+void renderProfile(string& out, const TurnProfiler& profiler) {
+    char header[160];
+    std::snprintf(header, sizeof(header), "%-10s %10s %10s %10s %10s %10s %10s\n",
+                  "latency us", "count", "mean", "p50", "p99", "p99.9", "max");
+    out += header;
+    renderLine(out, "turn", profiler.turns);
+    for(int phase = 0; phase < PHASE_COUNT; ++phase){
+        renderLine(out, PHASE_NAME[phase], profiler.phases[phase]);
+    }
+}
+
+/**
+ * Remember a SIGUSR1 so the game prints its report after the turn in progress.
+ */
+static void requestReport(int) {
+    reportWanted = 1;
+}
+
+/**
+ * Ask for a latency report on SIGUSR1. Reads are restarted, so a waiting prompt is not disturbed.
+ */
+void watchProfileSignal() {
+    struct sigaction action;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    action.sa_handler = requestReport;
+    sigaction(SIGUSR1, &action, nullptr);
+}
+
+/**
+ * @return  true once for every SIGUSR1 received since the last call.
+ */
+bool profileRequested() {
+    if(reportWanted == 0){
+        return false;
+    }
+    reportWanted = 0;
+    return true;
+}
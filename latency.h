@@ -0,0 +1,78 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+#include <array>
+#include <cstdint>
+#include <string>
+
+// phases of a turn, timed separately
+const int PHASE_INPUT    = 0;   // checking the command
+const int PHASE_MOVE     = 1;   // doPlayerMove
+const int PHASE_MONSTERS = 2;   // doMonsterAttack and the listed monsters
+const int PHASE_RESIZE   = 3;   // growing the map after an amulet
+const int PHASE_RENDER   = 4;   // building the frame shown to the player
+const int PHASE_COUNT    = 5;
+
+// histogram precision: 2^HISTOGRAM_SUB_BITS buckets per power of two, under 1% error
+const int HISTOGRAM_SUB_BITS = 7;
+const int HISTOGRAM_MAX_BITS = 40;  // about 18 minutes in nanoseconds; longer values land in the last bucket
+const int HISTOGRAM_BUCKETS = (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) << HISTOGRAM_SUB_BITS;
+
+// log-linear latency histogram in nanoseconds, in the style of HdrHistogram
+struct LatencyHistogram {
+    std::array<uint64_t, HISTOGRAM_BUCKETS> counts{};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+};
+
+// per-turn latency of a game, overall and by phase
+struct TurnProfiler {
+    LatencyHistogram turns{};
+    std::array<LatencyHistogram, PHASE_COUNT> phases{};
+};
+
+// times one phase of the current turn into the profiler and the trace; does nothing without either
+class PhaseTimer {
+public:
+    PhaseTimer(TurnProfiler* profiler, int phase);
+    ~PhaseTimer();
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    TurnProfiler* profiler;
+    int phase;
+    uint64_t start;
+};
+
+// times a whole turn like PhaseTimer; nested timers of the same turn are ignored
+class TurnTimer {
+public:
+    explicit TurnTimer(TurnProfiler* profiler);
+    ~TurnTimer();
+    TurnTimer(const TurnTimer&) = delete;
+    TurnTimer& operator=(const TurnTimer&) = delete;
+
+private:
+    TurnProfiler* profiler;
+    uint64_t start;             // 0 when not timing
+};
+
+// function signatures
+uint64_t monotonicNanos();
+
+int latencyBucket(uint64_t nanos);
+
+uint64_t latencyBucketTop(int bucket);
+
+void recordLatency(LatencyHistogram& histogram, uint64_t nanos);
+
+uint64_t latencyPercentile(const LatencyHistogram& histogram, double percentile);
+
+void renderProfile(std::string& out, const TurnProfiler& profiler);
+
+void watchProfileSignal();
+
+bool profileRequested();
+
+#endif
@@ -37,7 +37,6 @@ char** loadLevel(const string& fileName, int& maxRow, int& maxCol, Player& playe
     if(totalSpots <= 1){
         return nullptr;
     }
-    char** map = createMap(maxRow, maxCol);
     char spot;
 
     fin >> player.row;
@@ -51,10 +50,17 @@ char** loadLevel(const string& fileName, int& maxRow, int& maxCol, Player& playe
         return nullptr;
     }
 
+    // from here on every failure must release the map
+    char** map = createMap(maxRow, maxCol);
+    if(map == nullptr){
+        return nullptr;
+    }
+
     for(int row = 0; row < maxRow; row++){
         for(int col = 0; col < maxCol; col++){
             fin >> spot;
             if(fin.fail()){
+                deleteMap(map, maxRow);
                 return nullptr;
             }
             if(row == player.row && col == player.col){
@@ -75,6 +81,7 @@ char** loadLevel(const string& fileName, int& maxRow, int& maxCol, Player& playe
                 map[row][col] = TILE_EXIT;    
             } else{
                 // error, invalid map character
+                deleteMap(map, maxRow);
                 return nullptr;
             }
         }
@@ -82,6 +89,7 @@ char** loadLevel(const string& fileName, int& maxRow, int& maxCol, Player& playe
     fin >> spot;
     if(!fin.eof()){
         // error
+        deleteMap(map, maxRow);
         return nullptr;
     }
 
@@ -101,6 +109,7 @@ char** loadLevel(const string& fileName, int& maxRow, int& maxCol, Player& playe
         }
     }
     if(hasDoor == false && hasExit == false){
+        deleteMap(map, maxRow);
         return nullptr;
     }
     return map;
@@ -0,0 +1,182 @@
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "latency.h"
+#include "metrics.h"
+
+using std::string;
+
+// names and help of the counters in the exposition format
+static const char* METRIC_NAME[METRIC_COUNTERS] = {"dungeon_turns_total", "dungeon_level_loads_total",
+                                                   "dungeon_level_cache_hits_total", "dungeon_level_cache_misses_total",
+                                                   "dungeon_resizes_total"};
+static const char* METRIC_HELP[METRIC_COUNTERS] = {"Turns played.", "Rooms entered.",
+                                                   "Rooms entered from the level cache.", "Level files read.",
+                                                   "Maps doubled by an amulet."};
+
+// latency quantiles exported, as fractions
+static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+// one thread's metrics: only that thread writes them, so updates need no atomic read-modify-write,
+// and a scrape reads them with relaxed loads while the thread keeps going
+struct MetricsThread {
+    std::array<std::atomic<uint64_t>, METRIC_COUNTERS> counters{};
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> latency{};
+    std::atomic<uint64_t> latencySum{0};
+    std::atomic<uint64_t> latencyMax{0};
+};
+
+// registry of every thread's metrics; kept after the threads end so their counts stay in the totals
+static std::mutex metricsLock;
+static std::vector<std::unique_ptr<MetricsThread>> metricsThreads;
+static std::atomic<bool> metricsOn{false};
+
+// this thread's metrics, registered on its first update
+static thread_local MetricsThread* localMetrics = nullptr;
+
+/**
+ * @return  this thread's metrics.
+ */
+static MetricsThread& threadMetrics() {
+    if(localMetrics == nullptr){
+        std::lock_guard<std::mutex> guard(metricsLock);
+        metricsThreads.emplace_back(new MetricsThread());
+        localMetrics = metricsThreads.back().get();
+    }
+    return *localMetrics;
+}
+
+/**
+ * Add to a value only the calling thread writes.
+ * @updates value
+ */
+static void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/**
+ * Start collecting metrics on every thread.
+ */
+void startMetrics() {
+    metricsOn.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * @return  true if metrics are being collected.
+ */
+bool collectingMetrics() {
+    return metricsOn.load(std::memory_order_relaxed);
+}
+
+/**
+ * Count one event.
+ * @param   metric      METRIC_* counter.
+ */
+void countMetric(int metric) {
+    if(collectingMetrics()){
+        bump(threadMetrics().counters[metric], 1);
+    }
+}
+
+/**
+ * Count a played turn and its latency.
+ * @param   nanos       Time the turn took.
+ */
+void recordTurnMetric(uint64_t nanos) {
+    if(!collectingMetrics()){
+        return;
+    }
+    MetricsThread& metrics = threadMetrics();
+    bump(metrics.counters[METRIC_TURNS], 1);
+    bump(metrics.latency[latencyBucket(nanos)], 1);
+    bump(metrics.latencySum, nanos);
+    if(nanos > metrics.latencyMax.load(std::memory_order_relaxed)){
+        metrics.latencyMax.store(nanos, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @param   metric      METRIC_* counter.
+ * @return  the counter summed over all threads.
+ */
+uint64_t metricTotal(int metric) {
+    std::lock_guard<std::mutex> guard(metricsLock);
+    uint64_t total = 0;
+    for(const std::unique_ptr<MetricsThread>& metrics : metricsThreads){
+        total += metrics->counters[metric].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * Render every metric in the Prometheus text exposition format, summing the threads' counts.
+ * @param   out         Text to write, appended to.
+ * @param   gauges      Values sampled by the server.
+ * @updates out
+ */
+void renderMetrics(string& out, const MetricsGauges& gauges) {
+    std::array<uint64_t, METRIC_COUNTERS> totals{};
+    LatencyHistogram latency;
+    {
+        std::lock_guard<std::mutex> guard(metricsLock);
+        for(const std::unique_ptr<MetricsThread>& metrics : metricsThreads){
+            for(int metric = 0; metric < METRIC_COUNTERS; ++metric){
+                totals[metric] += metrics->counters[metric].load(std::memory_order_relaxed);
+            }
+            for(int bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket){
+                uint64_t count = metrics->latency[bucket].load(std::memory_order_relaxed);
+                latency.counts[bucket] += count;
+                latency.total += count;
+            }
+            latency.sum += metrics->latencySum.load(std::memory_order_relaxed);
+            uint64_t max = metrics->latencyMax.load(std::memory_order_relaxed);
+            latency.max = max > latency.max ? max : latency.max;
+        }
+    }
+
+    char line[160];
+    for(int metric = 0; metric < METRIC_COUNTERS; ++metric){
+        std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", METRIC_NAME[metric], METRIC_HELP[metric],
+                      METRIC_NAME[metric], METRIC_NAME[metric], static_cast<unsigned long long>(totals[metric]));
+        out += line;
+    }
+
+    out += "# HELP dungeon_active_sessions Open client sessions.\n# TYPE dungeon_active_sessions gauge\n";
+    out += "dungeon_active_sessions " + std::to_string(gauges.activeSessions) + "\n";
+    out += "# HELP dungeon_map_bytes Bytes of the live maps of all sessions.\n# TYPE dungeon_map_bytes gauge\n";
+    out += "dungeon_map_bytes " + std::to_string(gauges.mapBytes) + "\n";
+    std::snprintf(line, sizeof(line), "# HELP dungeon_turns_per_second Turns played per second since the previous write.\n"
+                  "# TYPE dungeon_turns_per_second gauge\ndungeon_turns_per_second %.3f\n", gauges.turnsPerSecond);
+    out += line;
+
+    out += "# HELP dungeon_turn_latency_seconds Time to play a turn and render its frame.\n";
+    out += "# TYPE dungeon_turn_latency_seconds summary\n";
+    for(double quantile : QUANTILES){
+        std::snprintf(line, sizeof(line), "dungeon_turn_latency_seconds{quantile=\"%g\"} %.9f\n", quantile,
+                      static_cast<double>(latencyPercentile(latency, quantile * 100.0)) / 1e9);
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "dungeon_turn_latency_seconds_sum %.9f\ndungeon_turn_latency_seconds_count %llu\n",
+                  static_cast<double>(latency.sum) / 1e9, static_cast<unsigned long long>(latency.total));
+    out += line;
+}
+
+/**
+ * Replace a file with new text, writing a temporary file first so a scraper never sees half of it.
+ * @param   fileName    File to replace.
+ * @param   text        New contents.
+ * @return  false if the file could not be written.
+ */
+bool writeMetricsFile(const string& fileName, const string& text) {
+    string temporary = fileName + ".tmp";
+    std::FILE* file = std::fopen(temporary.c_str(), "w");
+    if(file == nullptr){
+        return false;
+    }
+    bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    written = std::fclose(file) == 0 && written;
+    return written && std::rename(temporary.c_str(), fileName.c_str()) == 0;
+}
@@ -0,0 +1,36 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <cstdint>
+#include <string>
+
+// counters, indexed by METRIC_*
+const int METRIC_TURNS              = 0;    // turns played, valid or not
+const int METRIC_LEVEL_LOADS        = 1;    // rooms entered
+const int METRIC_LEVEL_CACHE_HITS   = 2;    // rooms entered without reading the level file
+const int METRIC_LEVEL_CACHE_MISSES = 3;    // level files read
+const int METRIC_RESIZES            = 4;    // maps doubled by an amulet
+const int METRIC_COUNTERS           = 5;
+
+// values only the server's event loop knows, sampled when the metrics are written
+struct MetricsGauges {
+    uint64_t activeSessions = 0;
+    uint64_t mapBytes = 0;      // live maps of every session
+    double turnsPerSecond = 0.0;    // since the previous write
+};
+
+// function signatures
+void startMetrics();
+
+bool collectingMetrics();
+
+void countMetric(int metric);
+
+void recordTurnMetric(uint64_t nanos);
+
+uint64_t metricTotal(int metric);
+
+void renderMetrics(std::string& out, const MetricsGauges& gauges);
+
+bool writeMetricsFile(const std::string& fileName, const std::string& text);
+
+#endif
@@ -0,0 +1,396 @@
+#include <algorithm>
+#include <cstdlib>
+#include "journal.h"
+#include "monsters.h"
+
+// per type: tile on the grid and steps per turn, indexed by MONSTER_*
+static const char MONSTER_TILE[MONSTER_TYPES] = {TILE_CHASER, TILE_FAST, TILE_SLEEPER, TILE_HUGGER};
+static const uint8_t MONSTER_SPEED[MONSTER_TYPES] = {1, 2, 0, 1};
+
+// headings, clockwise from up, so turning right is heading + 1
+static const int HEADING_ROW[4] = {-1, 0, 1, 0};
+static const int HEADING_COL[4] = {0, 1, 0, -1};
+
+/**
+ * @param   tile    Map tile.
+ * @return  MONSTER_* type of the tile, or -1 if no listed monster uses it.
+ */
+int monsterType(char tile) {
+    for(int type = 0; type < MONSTER_TYPES; ++type){
+        if(MONSTER_TILE[type] == tile){
+            return type;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @param   tile    Map tile.
+ * @return  true for any monster, listed or a plain 'M'.
+ */
+bool isMonsterTile(char tile) {
+    return tile == TILE_MONSTER || monsterType(tile) >= 0;
+}
+
+/**
+ * Forget the list, so the next update rebuilds it from the grid. Called whenever the
+ * whole map is rewritten behind the list's back: a new room or a loaded save.
+ * @param   list        List to clear.
+ * @updates list
+ */
+void resetMonsters(MonsterList& list) {
+    list.row.clear();
+    list.col.clear();
+    list.type.clear();
+    list.speed.clear();
+    list.state.clear();
+    list.map = nullptr;
+    list.maxRow = 0;
+    list.maxCol = 0;
+}
+
+/**
+ * Rebuild the list from the monster tiles on the grid, in row-major order.
+ * @param   list        List to fill.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @updates list
+ */
+void buildMonsters(MonsterList& list, char** map, int maxRow, int maxCol) {
+    resetMonsters(list);
+    list.map = map;
+    list.maxRow = maxRow;
+    list.maxCol = maxCol;
+    for(int row = 0; row < maxRow; ++row){
+        for(int col = 0; col < maxCol; ++col){
+            int type = monsterType(map[row][col]);
+            if(type < 0){
+                continue;
+            }
+            list.row.push_back(row);
+            list.col.push_back(col);
+            list.type.push_back(static_cast<uint8_t>(type));
+            list.speed.push_back(MONSTER_SPEED[type]);
+            list.state.push_back(0);
+        }
+    }
+}
+
+/**
+ * @param   list        Monster list.
+ * @return  number of live monsters in the list.
+ */
+size_t monsterCount(const MonsterList& list) {
+    return list.row.size();
+}
+
+/**
+ * Remove a monster by moving the last one into its slot.
+ * @param   list        Monster list.
+ * @param   index       Monster to remove.
+ * @updates list
+ */
+static void removeMonster(MonsterList& list, size_t index) {
+    size_t last = list.row.size() - 1;
+    list.row[index] = list.row[last];
+    list.col[index] = list.col[last];
+    list.type[index] = list.type[last];
+    list.speed[index] = list.speed[last];
+    list.state[index] = list.state[last];
+    list.row.pop_back();
+    list.col.pop_back();
+    list.type.pop_back();
+    list.speed.pop_back();
+    list.state.pop_back();
+}
+
+/**
+ * @param   a           Position.
+ * @param   b           Position.
+ * @return  true if a comes before b in row-major order.
+ */
+static bool beforeCell(const MonsterHeading& a, const MonsterHeading& b) {
+    return a.row != b.row ? a.row < b.row : a.col < b.col;
+}
+
+/**
+ * Gather the headings of the list's huggers, sorted by position. A list built for another
+ * map is about to be rebuilt with every hugger facing up, so it gives no headings.
+ * Costs O(monsters + huggers * log huggers).
+ * @param   list        Monster list.
+ * @param   map         Dungeon map the headings are wanted for.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   out         Headings, replaced.
+ * @updates out
+ */
+void collectHeadings(const MonsterList& list, char** map, int maxRow, int maxCol, std::vector<MonsterHeading>& out) {
+    out.clear();
+    if(list.map != map || list.maxRow != maxRow || list.maxCol != maxCol){
+        return;
+    }
+    for(size_t index = 0; index < list.row.size(); ++index){
+        if(list.type[index] == MONSTER_HUGGER && list.state[index] != 0){
+            out.push_back(MonsterHeading{list.row[index], list.col[index], list.state[index]});
+        }
+    }
+    std::sort(out.begin(), out.end(), beforeCell);
+}
+
+/**
+ * @param   headings    Headings sorted by position, as collectHeadings gives them.
+ * @param   row         Cell row.
+ * @param   col         Cell column.
+ * @return  heading of the hugger on the cell, 0 (up) if none is listed there.
+ */
+uint8_t headingAt(const std::vector<MonsterHeading>& headings, int row, int col) {
+    MonsterHeading cell{row, col, 0};
+    auto found = std::lower_bound(headings.begin(), headings.end(), cell, beforeCell);
+    return found != headings.end() && found->row == row && found->col == col ? found->heading : 0;
+}
+
+/**
+ * Rebuild the list from the grid and turn its huggers back to the given headings.
+ * @param   list        List to fill.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   headings    Headings sorted by position; huggers not in it face up.
+ * @updates list
+ */
+void restoreHeadings(MonsterList& list, char** map, int maxRow, int maxCol, const std::vector<MonsterHeading>& headings) {
+    buildMonsters(list, map, maxRow, maxCol);
+    // both are in row-major order
+    size_t next = 0;
+    for(size_t index = 0; index < list.row.size() && next < headings.size(); ++index){
+        MonsterHeading cell{list.row[index], list.col[index], 0};
+        while(next < headings.size() && beforeCell(headings[next], cell)){
+            ++next;
+        }
+        if(next < headings.size() && !beforeCell(cell, headings[next]) && list.type[index] == MONSTER_HUGGER){
+            list.state[index] = headings[next].heading;
+        }
+    }
+}
+
+/**
+ * Bring the list up to date with cells rewritten behind its back by undo or redo, without
+ * rebuilding it: the monsters on rewritten cells are dropped and the listed monsters those
+ * cells now hold are added, huggers with the heading the change recorded for them.
+ * Costs O(count + monsters * log count). A list built for another map is left alone; the
+ * next update rebuilds it anyway.
+ * @param   list        Monster list of the map.
+ * @param   map         Dungeon map, already rewritten.
+ * @param   changes     Rewritten cells, sorted by row, then column.
+ * @param   count       Number of rewritten cells.
+ * @param   undone      true if the cells were set back to their before values, false if redone.
+ * @updates list
+ */
+void applyCellChanges(MonsterList& list, char** map, const CellChange* changes, size_t count, bool undone) {
+    if(list.map != map || count == 0){
+        return;
+    }
+    const CellChange* end = changes + count;
+    for(size_t i = list.row.size(); i > 0; --i){
+        size_t index = i - 1;
+        int row = list.row[index];
+        int col = list.col[index];
+        bool rewritten = std::binary_search(changes, end, CellChange{row, col, 0, 0}, [](const CellChange& a, const CellChange& b){
+            return a.row != b.row ? a.row < b.row : a.col < b.col;
+        });
+        if(rewritten || map[row][col] != MONSTER_TILE[list.type[index]]){
+            removeMonster(list, index);
+        }
+    }
+    for(const CellChange* change = changes; change != end; ++change){
+        int type = monsterType(map[change->row][change->col]);
+        if(type < 0){
+            continue;
+        }
+        list.row.push_back(change->row);
+        list.col.push_back(change->col);
+        list.type.push_back(static_cast<uint8_t>(type));
+        list.speed.push_back(MONSTER_SPEED[type]);
+        list.state.push_back(type == MONSTER_HUGGER ? (undone ? change->headingBefore : change->headingAfter) : 0);
+    }
+}
+
+/**
+ * Move a monster one cell on both the grid and the list. Like an 'M', it flattens whatever
+ * it steps on, the player included.
+ * @param   list        Monster list.
+ * @param   index       Monster to move.
+ * @param   nextRow     Row to step onto.
+ * @param   nextCol     Column to step onto.
+ * @param   map         Dungeon map.
+ * @param   player      Player, after the move.
+ * @param   journal     Journal with an open turn, or nullptr.
+ * @return  true if the monster stepped onto the player.
+ * @updates list, map, journal
+ */
+static bool stepMonster(MonsterList& list, size_t index, int nextRow, int nextCol, char** map, const Player& player, Journal* journal) {
+    int row = list.row[index];
+    int col = list.col[index];
+    if(journal != nullptr){
+        recordCell(*journal, map, row, col);
+        recordCell(*journal, map, nextRow, nextCol);
+    }
+    map[row][col] = TILE_OPEN;
+    map[nextRow][nextCol] = MONSTER_TILE[list.type[index]];
+    list.row[index] = nextRow;
+    list.col[index] = nextCol;
+    return nextRow == player.row && nextCol == player.col;
+}
+
+/**
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   row         Cell row, may be off the map.
+ * @param   col         Cell column, may be off the map.
+ * @return  true if a monster could step onto the cell right now.
+ */
+static bool freeCell(char** map, int maxRow, int maxCol, int row, int col) {
+    return row >= 0 && col >= 0 && row < maxRow && col < maxCol
+           && flowWalkable(map[row][col]) && !isMonsterTile(map[row][col]);
+}
+
+/**
+ * @return  true if the cell is a wall for a hugger: off the map, a pillar, a door or the exit.
+ */
+static bool wallCell(char** map, int maxRow, int maxCol, int row, int col) {
+    return row < 0 || col < 0 || row >= maxRow || col >= maxCol || !flowWalkable(map[row][col]);
+}
+
+/**
+ * Take one step down the flow field; a monster whose downhill cells are all taken waits.
+ * @return  1 if the monster caught the player, 0 if it moved, -1 if it could not move.
+ */
+static int chaseStep(MonsterList& list, size_t index, const FlowField& field, char** map, int maxRow, int maxCol,
+                     const Player& player, Journal* journal) {
+    int row = list.row[index];
+    int col = list.col[index];
+    int downhill = flowDistance(field, row, col) - 1;
+    if(downhill < 0){
+        return -1;
+    }
+    for(int heading : {0, 2, 1, 3}){
+        int nextRow = row + HEADING_ROW[heading];
+        int nextCol = col + HEADING_COL[heading];
+        if(freeCell(map, maxRow, maxCol, nextRow, nextCol) && flowDistance(field, nextRow, nextCol) == downhill){
+            return stepMonster(list, index, nextRow, nextCol, map, player, journal) ? 1 : 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Move a hugger: bite the player if next to it, otherwise follow the wall on its right.
+ * Away from any wall it walks straight until it finds one.
+ * @return  true if the hugger caught the player.
+ */
+static bool hugStep(MonsterList& list, size_t index, char** map, int maxRow, int maxCol, const Player& player, Journal* journal) {
+    int row = list.row[index];
+    int col = list.col[index];
+    if(std::abs(player.row - row) + std::abs(player.col - col) == 1){
+        return stepMonster(list, index, player.row, player.col, map, player, journal);
+    }
+    bool touching = false;
+    for(int heading = 0; heading < 4; ++heading){
+        touching = touching || wallCell(map, maxRow, maxCol, row + HEADING_ROW[heading], col + HEADING_COL[heading]);
+    }
+    int heading = list.state[index];
+    const int turns[4] = {touching ? 1 : 0, touching ? 0 : 1, 3, 2};
+    for(int turn : turns){
+        int next = (heading + turn) % 4;
+        int nextRow = row + HEADING_ROW[next];
+        int nextCol = col + HEADING_COL[next];
+        if(freeCell(map, maxRow, maxCol, nextRow, nextCol)){
+            list.state[index] = static_cast<uint8_t>(next);
+            return stepMonster(list, index, nextRow, nextCol, map, player, journal);
+        }
+    }
+    return false;
+}
+
+/**
+ * Move every listed monster for one turn. The list is checked against the grid first, so
+ * monsters flattened by an 'M' drop out; then the monsters move nearest first, so a queue of
+ * them advances together, and in row-major order at equal distance, so the outcome depends
+ * only on the grid and the huggers' headings, not on the order of the list. Chasers and fast monsters walk down the shared flow field, a
+ * sleeper close enough to the player wakes up as a chaser, and huggers patrol.
+ * @param   list        Monster list of the map; rebuilt if it belongs to another map.
+ * @param   field       Flow field of the map; updated to the player's cell if anything chases.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   player      Player, after the move.
+ * @param   journal     Journal with an open turn to record the moves in, or nullptr.
+ * @return  true if a monster reached the player.
+ * @updates list, field, map, journal
+ */
+bool updateMonsters(MonsterList& list, FlowField& field, char** map, int maxRow, int maxCol, const Player& player, Journal* journal) {
+    if(list.map != map || list.maxRow != maxRow || list.maxCol != maxCol){
+        buildMonsters(list, map, maxRow, maxCol);
+    }
+    bool chasing = false;
+    for(size_t i = list.row.size(); i > 0; --i){
+        size_t index = i - 1;
+        if(map[list.row[index]][list.col[index]] != MONSTER_TILE[list.type[index]]){
+            removeMonster(list, index);
+            continue;
+        }
+        chasing = chasing || list.type[index] != MONSTER_HUGGER;
+    }
+    if(list.row.empty()){
+        return false;
+    }
+    if(chasing){
+        updateFlowField(field, map, maxRow, maxCol, player);
+    }
+
+    list.order.clear();
+    for(size_t index = 0; index < list.row.size(); ++index){
+        int distance = chasing ? flowDistance(field, list.row[index], list.col[index]) : -1;
+        uint64_t key = distance < 0 ? UINT32_MAX : static_cast<uint64_t>(distance);
+        list.order.push_back(key << 32 | index);
+    }
+    std::sort(list.order.begin(), list.order.end(), [&list](uint64_t a, uint64_t b){
+        if(a >> 32 != b >> 32){
+            return a < b;
+        }
+        size_t first = static_cast<size_t>(a & UINT32_MAX);
+        size_t second = static_cast<size_t>(b & UINT32_MAX);
+        return list.row[first] != list.row[second] ? list.row[first] < list.row[second] : list.col[first] < list.col[second];
+    });
+
+    bool eaten = false;
+    for(uint64_t packed : list.order){
+        size_t index = static_cast<size_t>(packed & UINT32_MAX);
+        uint64_t distance = packed >> 32;
+        if(list.type[index] == MONSTER_SLEEPER){
+            if(distance <= SLEEPER_WAKE_DISTANCE){
+                if(journal != nullptr){
+                    recordCell(*journal, map, list.row[index], list.col[index]);
+                }
+                list.type[index] = MONSTER_CHASER;
+                list.speed[index] = MONSTER_SPEED[MONSTER_CHASER];
+                map[list.row[index]][list.col[index]] = TILE_CHASER;
+            }
+            continue;
+        }
+        if(list.type[index] == MONSTER_HUGGER){
+            eaten = hugStep(list, index, map, maxRow, maxCol, player, journal) || eaten;
+            continue;
+        }
+        for(int step = 0; step < list.speed[index]; ++step){
+            int moved = chaseStep(list, index, field, map, maxRow, maxCol, player, journal);
+            eaten = eaten || moved == 1;
+            if(moved != 0){
+                break;
+            }
+        }
+    }
+    return eaten;
+}
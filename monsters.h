@@ -0,0 +1,68 @@
+#ifndef MONSTERS_H
+#define MONSTERS_H
+#include <cstdint>
+#include <vector>
+#include "flowfield.h"
+#include "logic.h"
+
+// tiles of the monsters kept in a MonsterList; plain 'M' monsters stay with doMonsterAttack
+const char TILE_CHASER  = 'C';  // walks around obstacles toward the player
+const char TILE_FAST    = 'F';  // a chaser that takes two steps per turn
+const char TILE_SLEEPER = 'Z';  // sleeps until the player comes close, then chases
+const char TILE_HUGGER  = 'H';  // patrols with a wall on its right and bites when the player is next to it
+
+// monster types, indexes into the tables in monsters.cpp
+const uint8_t MONSTER_CHASER  = 0;
+const uint8_t MONSTER_FAST    = 1;
+const uint8_t MONSTER_SLEEPER = 2;
+const uint8_t MONSTER_HUGGER  = 3;
+const int MONSTER_TYPES = 4;
+
+// a sleeper wakes when the player is this many steps away or closer
+const int SLEEPER_WAKE_DISTANCE = 4;
+
+struct Journal;
+struct CellChange;
+
+// a hugger's heading by position, so undo and saved games can put huggers back as they were
+struct MonsterHeading {
+    int32_t row = 0;
+    int32_t col = 0;
+    uint8_t heading = 0;
+};
+
+// live monsters of the current map as parallel arrays, mirroring their tiles on the grid
+struct MonsterList {
+    std::vector<int32_t> row{};
+    std::vector<int32_t> col{};
+    std::vector<uint8_t> type{};    // MONSTER_*
+    std::vector<uint8_t> speed{};   // steps per turn
+    std::vector<uint8_t> state{};   // hugger: heading, 0 up, 1 right, 2 down, 3 left
+    std::vector<uint64_t> order{};  // scratch: distance << 32 | index, nearest first, then row-major
+    char** map = nullptr;           // map the list was built from
+    int maxRow = 0;
+    int maxCol = 0;
+};
+
+// function signatures
+int monsterType(char tile);
+
+bool isMonsterTile(char tile);
+
+void resetMonsters(MonsterList& list);
+
+void buildMonsters(MonsterList& list, char** map, int maxRow, int maxCol);
+
+size_t monsterCount(const MonsterList& list);
+
+void collectHeadings(const MonsterList& list, char** map, int maxRow, int maxCol, std::vector<MonsterHeading>& out);
+
+uint8_t headingAt(const std::vector<MonsterHeading>& headings, int row, int col);
+
+void restoreHeadings(MonsterList& list, char** map, int maxRow, int maxCol, const std::vector<MonsterHeading>& headings);
+
+void applyCellChanges(MonsterList& list, char** map, const CellChange* changes, size_t count, bool undone);
+
+bool updateMonsters(MonsterList& list, FlowField& field, char** map, int maxRow, int maxCol, const Player& player, Journal* journal);
+
+#endif
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include "multiplayer.h"
+
+MultiSession::MultiSession()
+    : map(nullptr), maxRow(0), maxCol(0), players(), state(), status(), ticks(0), entities() {
+}
+
+MultiSession::~MultiSession() {
+    endMultiSession(*this);
+}
+
+/**
+ * Copy a level and place the players: player 0 on the level's start, the others on the
+ * open tiles nearest to it in breadth-first order (up, down, left, right), so the layout
+ * is the same every time. Ticks only play 'M' monsters, so levels with listed monsters
+ * are refused.
+ * @param   session     Session to (re)initialize.
+ * @param   level       Level to play.
+ * @param   playerCount Number of players.
+ * @return  false if the level holds a listed monster, the map could not be allocated or
+ *          it has too few open tiles.
+ * @updates session
+ */
+bool startMultiSession(MultiSession& session, const LevelTemplate& level, int playerCount) {
+    endMultiSession(session);
+    for(char tile : level.tiles){
+        if(monsterType(tile) >= 0){
+            return false;
+        }
+    }
+    session.map = createMap(level.maxRow, level.maxCol);
+    if(session.map == nullptr || playerCount < 1){
+        return false;
+    }
+    session.maxRow = level.maxRow;
+    session.maxCol = level.maxCol;
+    for(int row = 0; row < level.maxRow; ++row){
+        std::memcpy(session.map[row], &level.tiles[static_cast<size_t>(row) * level.maxCol], level.maxCol);
+    }
+
+    const int stepRow[4] = {-1, 1, 0, 0};
+    const int stepCol[4] = {0, 0, -1, 1};
+    std::vector<char> seen(static_cast<size_t>(level.maxRow) * level.maxCol, 0);
+    std::deque<std::pair<int, int>> frontier;
+    frontier.emplace_back(level.startRow, level.startCol);
+    seen[static_cast<size_t>(level.startRow) * level.maxCol + level.startCol] = 1;
+    while(!frontier.empty() && static_cast<int>(session.players.size()) < playerCount){
+        std::pair<int, int> cell = frontier.front();
+        frontier.pop_front();
+        char tile = session.map[cell.first][cell.second];
+        if(tile == TILE_PLAYER || tile == TILE_OPEN){
+            Player player;
+            player.row = cell.first;
+            player.col = cell.second;
+            player.treasure = 0;
+            session.players.push_back(player);
+            session.map[cell.first][cell.second] = TILE_PLAYER;
+        }
+        for(int dir = 0; dir < 4; ++dir){
+            int row = cell.first + stepRow[dir];
+            int col = cell.second + stepCol[dir];
+            if(row < 0 || col < 0 || row >= level.maxRow || col >= level.maxCol){
+                continue;
+            }
+            size_t index = static_cast<size_t>(row) * level.maxCol + col;
+            if(!seen[index] && session.map[row][col] != TILE_PILLAR){
+                seen[index] = 1;
+                frontier.emplace_back(row, col);
+            }
+        }
+    }
+    session.state.assign(session.players.size(), PLAYER_ACTIVE);
+    session.status.assign(session.players.size(), STATUS_STAY);
+    session.ticks = 0;
+    return static_cast<int>(session.players.size()) == playerCount;
+}
+
+// a monster's chosen prey for this tick
+struct MonsterTarget {
+    int row = 0;
+    int col = 0;
+    int distance = 0;
+    int player = 0;
+    int stepRow = 0;            // one step toward the prey
+    int stepCol = 0;
+};
+
+/**
+ * Play one tick for every player, then move the monsters.
+ *
+ * Moves are resolved against the positions at the start of the tick, so the result never
+ * depends on timing or on player order: a player cannot step onto a cell any player stood on
+ * at the start of the tick, even one that player leaves this tick, and if several players step
+ * onto the same cell (e.g. a treasure) the lowest index gets it and the others stay. Players
+ * who leave through a door or the exit are taken off the map and the door or exit is put back.
+ *
+ * Each monster then steps toward the nearest player that sees it along a row or column
+ * (ties go to the lowest player index). The spatial grid finds the monsters on each player's
+ * row and column, and a ray is walked only as far as the farthest of them, to check that no
+ * pillar is in the way. A tick costs O(players * (rows + cols) / SPATIAL_BUCKET) for the grid
+ * lookups plus the cells between the players and the monsters on their lines, instead of
+ * O(players * (rows + cols)) for walking every ray to its end.
+ * If any active player picked up an amulet, the map doubles once at the end of the tick.
+ * @param   session     Session to advance.
+ * @param   inputs      One command character per player; ignored for players no longer active.
+ * @return  number of players still active after the tick, 0 if the map could not grow.
+ * @updates session
+ */
+int stepMultiSession(MultiSession& session, const char* inputs) {
+    size_t count = session.players.size();
+    session.ticks++;
+
+    // claims on target cells, lowest player first; every starting cell is taken from the outset
+    std::vector<int> targetRow(count), targetCol(count);
+    std::vector<char> granted(count, 0);
+    std::unordered_map<long long, size_t> claimed;
+    for(size_t i = 0; i < count; ++i){
+        if(session.state[i] == PLAYER_ACTIVE){
+            claimed.emplace(static_cast<long long>(session.players[i].row) * session.maxCol + session.players[i].col, i);
+        }
+    }
+    for(size_t i = 0; i < count; ++i){
+        session.status[i] = STATUS_STAY;
+        if(session.state[i] != PLAYER_ACTIVE || inputs[i] == INPUT_STAY){
+            continue;
+        }
+        targetRow[i] = session.players[i].row;
+        targetCol[i] = session.players[i].col;
+        getDirection(inputs[i], targetRow[i], targetCol[i]);
+        if(targetRow[i] == session.players[i].row && targetCol[i] == session.players[i].col){
+            continue;
+        }
+        long long key = static_cast<long long>(targetRow[i]) * session.maxCol + targetCol[i];
+        if(claimed.emplace(key, i).second){
+            granted[i] = 1;
+        }
+    }
+
+    for(size_t i = 0; i < count; ++i){
+        if(!granted[i]){
+            continue;
+        }
+        Player& player = session.players[i];
+        bool inside = targetRow[i] >= 0 && targetCol[i] >= 0 && targetRow[i] < session.maxRow && targetCol[i] < session.maxCol;
+        char target = inside ? session.map[targetRow[i]][targetCol[i]] : TILE_PILLAR;
+        session.status[i] = doPlayerMove(session.map, session.maxRow, session.maxCol, player, targetRow[i], targetCol[i]);
+        if(session.status[i] == STATUS_LEAVE || session.status[i] == STATUS_ESCAPE){
+            session.map[player.row][player.col] = target;
+            session.state[i] = session.status[i] == STATUS_LEAVE ? PLAYER_LEFT : PLAYER_ESCAPED;
+        }
+    }
+
+    // pick a prey for every monster in sight of an active player
+    const int rayRow[4] = {-1, 1, 0, 0};
+    const int rayCol[4] = {0, 0, 1, -1};
+    std::unordered_map<long long, MonsterTarget> monsters;
+    SpatialGrid& grid = session.entities;
+    syncSpatialGrid(grid, session.map, session.maxRow, session.maxCol);
+    for(size_t i = 0; i < count; ++i){
+        if(session.state[i] != PLAYER_ACTIVE){
+            continue;
+        }
+        const Player& player = session.players[i];
+        // how far each ray has to be walked: up to the farthest 'M' on that side
+        int reach[4] = {0, 0, 0, 0};
+        for(const SpatialEntry& entry : entitiesOnColumn(grid, player.col, 0, session.maxRow - 1, TILE_MONSTER)){
+            int ray = entry.row < player.row ? 0 : 1;
+            reach[ray] = std::max(reach[ray], std::abs(entry.row - player.row));
+        }
+        for(const SpatialEntry& entry : entitiesOnRow(grid, player.row, 0, session.maxCol - 1, TILE_MONSTER)){
+            int ray = entry.col > player.col ? 2 : 3;
+            reach[ray] = std::max(reach[ray], std::abs(entry.col - player.col));
+        }
+        for(int ray = 0; ray < 4; ++ray){
+            int row = player.row + rayRow[ray];
+            int col = player.col + rayCol[ray];
+            for(int distance = 1; distance <= reach[ray] && session.map[row][col] != TILE_PILLAR; ++distance){
+                if(session.map[row][col] == TILE_MONSTER){
+                    long long key = static_cast<long long>(row) * session.maxCol + col;
+                    auto found = monsters.find(key);
+                    if(found == monsters.end() || distance < found->second.distance){
+                        MonsterTarget target;
+                        target.row = row;
+                        target.col = col;
+                        target.distance = distance;
+                        target.player = static_cast<int>(i);
+                        target.stepRow = -rayRow[ray];
+                        target.stepCol = -rayCol[ray];
+                        monsters[key] = target;
+                    }
+                }
+                row += rayRow[ray];
+                col += rayCol[ray];
+            }
+        }
+    }
+
+    // nearest monsters move first so a line of monsters advances together, as in doMonsterAttack
+    std::vector<MonsterTarget> moving;
+    moving.reserve(monsters.size());
+    for(const auto& entry : monsters){
+        moving.push_back(entry.second);
+    }
+    std::sort(moving.begin(), moving.end(), [](const MonsterTarget& a, const MonsterTarget& b) {
+        if(a.distance != b.distance){
+            return a.distance < b.distance;
+        }
+        return a.row != b.row ? a.row < b.row : a.col < b.col;
+    });
+    for(const MonsterTarget& monster : moving){
+        int row = monster.row + monster.stepRow;
+        int col = monster.col + monster.stepCol;
+        session.map[monster.row][monster.col] = TILE_OPEN;
+        if(session.map[row][col] == TILE_PLAYER){
+            for(size_t i = 0; i < count; ++i){
+                if(session.state[i] == PLAYER_ACTIVE && session.players[i].row == row && session.players[i].col == col){
+                    session.state[i] = PLAYER_DEAD;
+                }
+            }
+        }
+        session.map[row][col] = TILE_MONSTER;
+    }
+
+    // re-index the monsters that moved; two of them may have ended up on one cell
+    for(const MonsterTarget& monster : moving){
+        removeEntity(grid, monster.row, monster.col);
+    }
+    for(const MonsterTarget& monster : moving){
+        int row = monster.row + monster.stepRow;
+        int col = monster.col + monster.stepCol;
+        removeEntity(grid, row, col);
+        if(session.map[row][col] == TILE_MONSTER){
+            addEntity(grid, row, col);
+        }
+    }
+
+    // any amulet picked up this tick grows the map once, as in the single player game
+    int active = 0;
+    bool amulet = false;
+    for(size_t i = 0; i < count; ++i){
+        active += session.state[i] == PLAYER_ACTIVE ? 1 : 0;
+        amulet = amulet || (session.state[i] == PLAYER_ACTIVE && session.status[i] == STATUS_AMULET);
+    }
+    if(amulet){
+        int newRow = session.maxRow;
+        int newCol = session.maxCol;
+        session.map = resizeMap(session.map, newRow, newCol);
+        session.maxRow = session.map == nullptr ? 0 : newRow;
+        session.maxCol = session.map == nullptr ? 0 : newCol;
+    }
+    return session.map == nullptr ? 0 : active;
+}
+
+/**
+ * Release the shared map and forget the players.
+ * @param   session     Session to clean up.
+ * @updates session
+ */
+void endMultiSession(MultiSession& session) {
+    deleteMap(session.map, session.maxRow);
+    session.maxCol = 0;
+    resetSpatialGrid(session.entities);
+    session.players.clear();
+    session.state.clear();
+    session.status.clear();
+}
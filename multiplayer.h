@@ -0,0 +1,37 @@
+#ifndef MULTIPLAYER_H
+#define MULTIPLAYER_H
+#include <cstdint>
+#include <vector>
+#include "session.h"
+
+// per-player state in a shared level
+const int PLAYER_ACTIVE  = 0;
+const int PLAYER_LEFT    = 1;   // went through a door
+const int PLAYER_ESCAPED = 2;   // went through the exit
+const int PLAYER_DEAD    = 3;   // caught by a monster
+
+// several players on one map, moved together once per tick
+struct MultiSession {
+    char** map;
+    int maxRow;
+    int maxCol;
+    std::vector<Player> players;
+    std::vector<int> state;     // PLAYER_* per player
+    std::vector<int> status;    // STATUS_* of each player's last move
+    int ticks;
+    SpatialGrid entities;       // 'M' monsters, treasures and amulets by position
+
+    MultiSession();
+    ~MultiSession();
+    MultiSession(const MultiSession&) = delete;
+    MultiSession& operator=(const MultiSession&) = delete;
+};
+
+// function signatures
+bool startMultiSession(MultiSession& session, const LevelTemplate& level, int playerCount);
+
+int stepMultiSession(MultiSession& session, const char* inputs);
+
+void endMultiSession(MultiSession& session);
+
+#endif
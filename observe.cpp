@@ -0,0 +1,131 @@
+#include <cstring>
+#include "observe.h"
+
+// tile of each channel, matching the order documented in observe.h
+static const char CHANNEL_TILE[OBS_CHANNELS] = {
+    TILE_OPEN, TILE_PLAYER, TILE_TREASURE, TILE_AMULET, TILE_MONSTER, TILE_PILLAR, TILE_DOOR, TILE_EXIT,
+    TILE_CHASER, TILE_FAST, TILE_SLEEPER, TILE_HUGGER
+};
+
+/**
+ * Number of bytes one observation takes in the given encoding.
+ * @param   format      OBS_TILES, OBS_ONE_HOT or OBS_BITS.
+ * @param   size        Window width and height.
+ * @return  bytes per observation.
+ */
+size_t observationBytes(int format, int size) {
+    size_t cells = static_cast<size_t>(size) * size;
+    if(format == OBS_ONE_HOT){
+        return cells * OBS_CHANNELS;
+    }
+    if(format == OBS_BITS){
+        return (cells + 7) / 8 * OBS_CHANNELS;
+    }
+    return cells;
+}
+
+/**
+ * Copy the size x size window centered on (centerRow, centerCol) into out.
+ * Cells outside the map read as TILE_PILLAR. Each window row is one memset of the
+ * padding plus one memcpy of the in-bounds span, so the cost is independent of map size.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   centerRow   Row at the center of the window, usually player.row.
+ * @param   centerCol   Column at the center of the window, usually player.col.
+ * @param   size        Window width and height; odd sizes keep the center exact.
+ * @param   out         size * size bytes, row-major.
+ * @updates out
+ */
+void extractWindow(char** map, int maxRow, int maxCol, int centerRow, int centerCol, int size, uint8_t* out) {
+    std::memset(out, TILE_PILLAR, static_cast<size_t>(size) * size);
+    if(map == nullptr){
+        return;
+    }
+    int top = centerRow - size / 2;
+    int left = centerCol - size / 2;
+    int colBegin = left < 0 ? -left : 0;
+    int colEnd = maxCol - left < size ? maxCol - left : size;
+    if(colBegin >= colEnd){
+        return;
+    }
+    int rowBegin = top < 0 ? -top : 0;
+    int rowEnd = maxRow - top < size ? maxRow - top : size;
+    for(int i = rowBegin; i < rowEnd; ++i){
+        std::memcpy(out + i * size + colBegin, map[top + i] + left + colBegin, colEnd - colBegin);
+    }
+}
+
+/**
+ * Encode a window of tile bytes. The per-channel loops are plain compares over
+ * contiguous bytes so the compiler turns them into vector compares.
+ * @param   tiles       size * size tile bytes from extractWindow.
+ * @param   size        Window width and height.
+ * @param   format      OBS_TILES, OBS_ONE_HOT or OBS_BITS.
+ * @param   out         observationBytes(format, size) bytes.
+ * @updates out
+ */
+void encodeWindow(const uint8_t* tiles, int size, int format, uint8_t* out) {
+    size_t cells = static_cast<size_t>(size) * size;
+    if(format == OBS_ONE_HOT){
+        for(int channel = 0; channel < OBS_CHANNELS; ++channel){
+            uint8_t tile = static_cast<uint8_t>(CHANNEL_TILE[channel]);
+            uint8_t* plane = out + channel * cells;
+            for(size_t i = 0; i < cells; ++i){
+                plane[i] = tiles[i] == tile ? 1 : 0;
+            }
+        }
+    } else if(format == OBS_BITS){
+        size_t planeBytes = (cells + 7) / 8;
+        std::memset(out, 0, planeBytes * OBS_CHANNELS);
+        for(int channel = 0; channel < OBS_CHANNELS; ++channel){
+            uint8_t tile = static_cast<uint8_t>(CHANNEL_TILE[channel]);
+            uint8_t* plane = out + channel * planeBytes;
+            size_t whole = cells / 8 * 8;
+            for(size_t i = 0; i < whole; i += 8){
+                uint8_t bits = 0;
+                for(int bit = 0; bit < 8; ++bit){
+                    bits |= static_cast<uint8_t>((tiles[i + bit] == tile) << bit);
+                }
+                plane[i / 8] = bits;
+            }
+            for(size_t i = whole; i < cells; ++i){
+                plane[i / 8] |= static_cast<uint8_t>((tiles[i] == tile) << (i % 8));
+            }
+        }
+    } else if(out != tiles){
+        std::memcpy(out, tiles, cells);
+    }
+}
+
+/**
+ * Observe the window around a session's player.
+ * @param   session     Session to observe.
+ * @param   size        Window width and height.
+ * @param   format      OBS_TILES, OBS_ONE_HOT or OBS_BITS.
+ * @param   out         observationBytes(format, size) bytes.
+ * @param   scratch     size * size bytes used for the raw tiles; ignored (may be nullptr) for OBS_TILES.
+ * @updates out, scratch
+ */
+void observeSession(const GameSession& session, int size, int format, uint8_t* out, uint8_t* scratch) {
+    uint8_t* tiles = format == OBS_TILES ? out : scratch;
+    extractWindow(session.map, session.maxRow, session.maxCol, session.player.row, session.player.col, size, tiles);
+    encodeWindow(tiles, size, format, out);
+}
+
+/**
+ * Observe many sessions in one call, writing their observations back to back.
+ * @param   sessions    Sessions to observe.
+ * @param   count       Number of sessions.
+ * @param   size        Window width and height.
+ * @param   format      OBS_TILES, OBS_ONE_HOT or OBS_BITS.
+ * @param   out         count * observationBytes(format, size) bytes.
+ * @param   scratch     size * size bytes owned by the caller and reused for every session; ignored (may be nullptr) for OBS_TILES.
+ * @updates out, scratch
+ */
+void observeBatch(const GameSession* const* sessions, int count, int size, int format, uint8_t* out, uint8_t* scratch) {
+    size_t stride = observationBytes(format, size);
+    for(int i = 0; i < count; ++i){
+        observeSession(*sessions[i], size, format, out + i * stride, scratch);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef OBSERVE_H
+#define OBSERVE_H
+#include <cstddef>
+#include <cstdint>
+#include "session.h"
+
+// observation encodings
+const int OBS_TILES   = 0;      // one tile byte per cell
+const int OBS_ONE_HOT = 1;      // OBS_CHANNELS planes of 0/1 bytes
+const int OBS_BITS    = 2;      // OBS_CHANNELS planes of one bit per cell, LSB first, each plane padded to whole bytes
+
+// one channel per tile type, in this order: open, player, treasure, amulet, monster, pillar, door, exit,
+// chaser, fast, sleeper, hugger
+const int OBS_CHANNELS = 12;
+
+// function signatures
+size_t observationBytes(int format, int size);
+
+void extractWindow(char** map, int maxRow, int maxCol, int centerRow, int centerCol, int size, uint8_t* out);
+
+void encodeWindow(const uint8_t* tiles, int size, int format, uint8_t* out);
+
+void observeSession(const GameSession& session, int size, int format, uint8_t* out, uint8_t* scratch);
+
+void observeBatch(const GameSession* const* sessions, int count, int size, int format, uint8_t* out, uint8_t* scratch);
+
+#endif
@@ -0,0 +1,212 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <memory>
+#include <mutex>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#include "perfcounters.h"
+
+using std::string;
+
+// names of the functions and events in reports
+static const char* FUNCTION_NAME[COUNTED_FUNCTIONS] = {"doMonsterAttack", "doPlayerMove", "resizeMap", "loadLevel"};
+static const char* COUNTER_NAME[COUNTERS] = {"cycles", "instructions", "cache-misses", "branch-misses"};
+static const uint64_t COUNTER_EVENT[COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                 PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+// one thread's event group and totals; a group is read with a single system call
+struct CounterThread {
+    int leader = -1;            // group leader fd, -1 if no event could be opened
+    std::array<int, COUNTERS> fds{};
+    std::array<int, COUNTERS> slot{};   // position of each event in a group read, -1 if unavailable
+    int opened = 0;
+    std::array<CounterTotals, COUNTED_FUNCTIONS> totals{};
+};
+
+// registry of every thread's counters; kept after the threads end so they can be reported at exit
+static std::mutex countersLock;
+static std::vector<std::unique_ptr<CounterThread>> counterThreads;
+static std::atomic<bool> countersOn{false};
+
+// this thread's counters, opened on its first measured call
+static thread_local CounterThread* localCounters = nullptr;
+
+/**
+ * Open the events of the calling thread as one group, user space only, skipping events
+ * the machine or the kernel's perf_event_paranoid setting does not allow.
+ * @param   counters    Thread's counters.
+ * @updates counters
+ */
+static void openCounters(CounterThread& counters) {
+    for(int counter = 0; counter < COUNTERS; ++counter){
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = COUNTER_EVENT[counter];
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, counters.leader, 0));
+        counters.fds[counter] = fd;
+        counters.slot[counter] = -1;
+        if(fd < 0){
+            continue;
+        }
+        if(counters.leader < 0){
+            counters.leader = fd;
+        }
+        counters.slot[counter] = counters.opened++;
+    }
+}
+
+/**
+ * @return  this thread's counters, registered and opened on first use.
+ */
+static CounterThread& threadCounters() {
+    if(localCounters == nullptr){
+        std::lock_guard<std::mutex> guard(countersLock);
+        counterThreads.emplace_back(new CounterThread());
+        localCounters = counterThreads.back().get();
+        openCounters(*localCounters);
+    }
+    return *localCounters;
+}
+
+/**
+ * Read the running values of this thread's events. The events form one group, so they are
+ * scheduled onto the PMU together and share one time enabled and one time running; when the
+ * kernel multiplexes the group with other events, running falls behind enabled.
+ * @param   counters    Thread's counters.
+ * @param   values      Value of every event, 0 for unavailable ones.
+ * @param   enabled     Nanoseconds the group has been enabled.
+ * @param   running     Nanoseconds the group has actually been counting.
+ * @return  false if the group cannot be read.
+ * @updates values, enabled, running
+ */
+static bool readCounters(const CounterThread& counters, std::array<uint64_t, COUNTERS>& values, uint64_t& enabled, uint64_t& running) {
+    // nr, time enabled, time running, then one value per event
+    uint64_t group[3 + COUNTERS];
+    ssize_t expected = static_cast<ssize_t>(sizeof(uint64_t)) * (3 + counters.opened);
+    if(counters.leader < 0 || read(counters.leader, group, sizeof(group)) != expected){
+        return false;
+    }
+    enabled = group[1];
+    running = group[2];
+    for(int counter = 0; counter < COUNTERS; ++counter){
+        int slot = counters.slot[counter];
+        values[counter] = slot < 0 ? 0 : group[3 + slot];
+    }
+    return true;
+}
+
+CounterScope::CounterScope(int function)
+    : function(function), active(false), start(), startEnabled(0), startRunning(0) {
+    if(counting()){
+        active = readCounters(threadCounters(), start, startEnabled, startRunning);
+    }
+}
+
+CounterScope::~CounterScope() {
+    if(!active){
+        return;
+    }
+    CounterThread& counters = *localCounters;
+    std::array<uint64_t, COUNTERS> end{};
+    uint64_t enabled = 0;
+    uint64_t running = 0;
+    if(!readCounters(counters, end, enabled, running)){
+        return;
+    }
+    CounterTotals& totals = counters.totals[function];
+    totals.calls++;
+    enabled -= startEnabled;
+    running -= startRunning;
+    if(running == 0){
+        totals.unscheduledCalls++;
+        return;
+    }
+
+    // the usual estimate while multiplexed: what was counted, stretched over the whole call
+    double scale = running < enabled ? static_cast<double>(enabled) / static_cast<double>(running) : 1.0;
+    totals.scaledCalls += running < enabled ? 1 : 0;
+    for(int counter = 0; counter < COUNTERS; ++counter){
+        totals.values[counter] += static_cast<uint64_t>(static_cast<double>(end[counter] - start[counter]) * scale + 0.5);
+    }
+}
+
+/**
+ * Start counting hardware events around the measured functions, on every thread that calls them.
+ */
+void startCounters() {
+    countersOn.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * @return  true if hardware events are being counted.
+ */
+bool counting() {
+    return countersOn.load(std::memory_order_relaxed);
+}
+
+/**
+ * Render the events per call of every measured function, summed over all threads, and
+ * which functions were measured while the events were multiplexed. Per-call figures are
+ * over the calls the events were running for. Call once the threads that count have stopped.
+ * @param   out         Text to print, appended to.
+ * @updates out
+ */
+void renderCounters(string& out) {
+    std::lock_guard<std::mutex> guard(countersLock);
+    std::array<CounterTotals, COUNTED_FUNCTIONS> sums{};
+    std::array<bool, COUNTERS> available{};
+    for(const std::unique_ptr<CounterThread>& counters : counterThreads){
+        for(int counter = 0; counter < COUNTERS; ++counter){
+            available[counter] = available[counter] || counters->slot[counter] >= 0;
+        }
+        for(int function = 0; function < COUNTED_FUNCTIONS; ++function){
+            sums[function].calls += counters->totals[function].calls;
+            sums[function].scaledCalls += counters->totals[function].scaledCalls;
+            sums[function].unscheduledCalls += counters->totals[function].unscheduledCalls;
+            for(int counter = 0; counter < COUNTERS; ++counter){
+                sums[function].values[counter] += counters->totals[function].values[counter];
+            }
+        }
+    }
+
+    char line[200];
+    std::snprintf(line, sizeof(line), "%-16s %10s %14s %14s %6s %14s %14s\n", "per call", "calls",
+                  COUNTER_NAME[COUNTER_CYCLES], COUNTER_NAME[COUNTER_INSTRUCTIONS], "IPC",
+                  COUNTER_NAME[COUNTER_CACHE_MISSES], COUNTER_NAME[COUNTER_BRANCH_MISSES]);
+    out += line;
+    for(int function = 0; function < COUNTED_FUNCTIONS; ++function){
+        const CounterTotals& sum = sums[function];
+        uint64_t counted = sum.calls - sum.unscheduledCalls;
+        double calls = counted == 0 ? 1.0 : static_cast<double>(counted);
+        double cycles = static_cast<double>(sum.values[COUNTER_CYCLES]);
+        double instructions = static_cast<double>(sum.values[COUNTER_INSTRUCTIONS]);
+        std::snprintf(line, sizeof(line), "%-16s %10llu %14.1f %14.1f %6.2f %14.1f %14.1f\n", FUNCTION_NAME[function],
+                      static_cast<unsigned long long>(sum.calls), cycles / calls, instructions / calls,
+                      cycles > 0.0 ? instructions / cycles : 0.0,
+                      static_cast<double>(sum.values[COUNTER_CACHE_MISSES]) / calls,
+                      static_cast<double>(sum.values[COUNTER_BRANCH_MISSES]) / calls);
+        out += line;
+    }
+    for(int function = 0; function < COUNTED_FUNCTIONS; ++function){
+        const CounterTotals& sum = sums[function];
+        if(sum.scaledCalls > 0 || sum.unscheduledCalls > 0){
+            std::snprintf(line, sizeof(line), "%s: events multiplexed on the PMU, %llu of %llu calls scaled, %llu not counted\n",
+                          FUNCTION_NAME[function], static_cast<unsigned long long>(sum.scaledCalls),
+                          static_cast<unsigned long long>(sum.calls), static_cast<unsigned long long>(sum.unscheduledCalls));
+            out += line;
+        }
+    }
+    for(int counter = 0; counter < COUNTERS && !counterThreads.empty(); ++counter){
+        if(!available[counter]){
+            out += string(COUNTER_NAME[counter]) + " not available (check /proc/sys/kernel/perf_event_paranoid)\n";
+        }
+    }
+}
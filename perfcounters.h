@@ -0,0 +1,52 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+#include <array>
+#include <cstdint>
+#include <string>
+
+// functions measured, indexed by COUNTED_*
+const int COUNTED_MONSTER_ATTACK = 0;   // doMonsterAttack
+const int COUNTED_PLAYER_MOVE    = 1;   // doPlayerMove
+const int COUNTED_RESIZE         = 2;   // resizeMap, or growMap when journaling
+const int COUNTED_LOAD           = 3;   // loading a room: level cache and map copy
+const int COUNTED_FUNCTIONS      = 4;
+
+// hardware events, indexed by COUNTER_*
+const int COUNTER_CYCLES        = 0;
+const int COUNTER_INSTRUCTIONS  = 1;
+const int COUNTER_CACHE_MISSES  = 2;
+const int COUNTER_BRANCH_MISSES = 3;
+const int COUNTERS              = 4;
+
+// counts of one function summed over its calls
+struct CounterTotals {
+    uint64_t calls = 0;
+    std::array<uint64_t, COUNTERS> values{};
+    uint64_t scaledCalls = 0;       // calls during which the events shared the PMU; their values are scaled up
+    uint64_t unscheduledCalls = 0;  // calls during which the events never ran; not in values
+};
+
+// counts the hardware events of this thread while in scope; does nothing unless counting
+class CounterScope {
+public:
+    explicit CounterScope(int function);
+    ~CounterScope();
+    CounterScope(const CounterScope&) = delete;
+    CounterScope& operator=(const CounterScope&) = delete;
+
+private:
+    int function;
+    bool active;
+    std::array<uint64_t, COUNTERS> start;
+    uint64_t startEnabled;
+    uint64_t startRunning;
+};
+
+// function signatures
+void startCounters();
+
+bool counting();
+
+void renderCounters(std::string& out);
+
+#endif
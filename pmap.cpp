@@ -0,0 +1,294 @@
+#include <vector>
+#include "pmap.h"
+#include "session.h"
+
+/**
+ * Build a persistent copy of a map. The persistent turn only plays 'M' monsters, so maps
+ * with listed monsters are refused rather than played by different rules.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @param   result      Persistent map with the same tiles.
+ * @return  false if the map holds a listed monster.
+ * @updates result
+ */
+bool makePersistentMap(char** map, int maxRow, int maxCol, PersistentMap& result) {
+    result = PersistentMap();
+    result.maxRow = maxRow;
+    result.maxCol = maxCol;
+    result.chunkCols = (maxCol + PMAP_CHUNK - 1) / PMAP_CHUNK;
+    int chunkRows = (maxRow + PMAP_CHUNK - 1) / PMAP_CHUNK;
+    long long chunkCount = static_cast<long long>(chunkRows) * result.chunkCols;
+
+    // build the leaves, then group them PMAP_FANOUT at a time until one node is left
+    std::vector<std::shared_ptr<const PMapNode>> level;
+    for(long long first = 0; first < chunkCount; first += PMAP_FANOUT){
+        std::shared_ptr<PMapLeaf> node = std::make_shared<PMapLeaf>();
+        for(int slot = 0; slot < PMAP_FANOUT && first + slot < chunkCount; ++slot){
+            long long index = first + slot;
+            int baseRow = static_cast<int>(index / result.chunkCols) * PMAP_CHUNK;
+            int baseCol = static_cast<int>(index % result.chunkCols) * PMAP_CHUNK;
+            std::shared_ptr<PMapChunk> chunk = std::make_shared<PMapChunk>();
+            for(int r = 0; r < PMAP_CHUNK; ++r){
+                for(int c = 0; c < PMAP_CHUNK; ++c){
+                    int row = baseRow + r;
+                    int col = baseCol + c;
+                    char tile = row < maxRow && col < maxCol ? map[row][col] : TILE_PILLAR;
+                    if(monsterType(tile) >= 0){
+                        result = PersistentMap();
+                        return false;
+                    }
+                    chunk->tiles[r * PMAP_CHUNK + c] = tile;
+                }
+            }
+            node->chunks[slot] = chunk;
+        }
+        level.push_back(node);
+    }
+    result.depth = 1;
+    while(level.size() > 1){
+        std::vector<std::shared_ptr<const PMapNode>> parents;
+        for(size_t first = 0; first < level.size(); first += PMAP_FANOUT){
+            std::shared_ptr<PMapInner> node = std::make_shared<PMapInner>();
+            for(size_t slot = 0; slot < PMAP_FANOUT && first + slot < level.size(); ++slot){
+                node->children[slot] = level[first + slot];
+            }
+            parents.push_back(node);
+        }
+        level.swap(parents);
+        result.depth++;
+    }
+    result.root = level.empty() ? std::make_shared<PMapLeaf>() : level[0];
+    return true;
+}
+
+/**
+ * @param   map         Persistent map.
+ * @return  chunks covered by one child of the root, PMAP_FANOUT to the power of depth - 1.
+ */
+static long long rootSpan(const PersistentMap& map) {
+    long long span = 1;
+    for(int level = 1; level < map.depth; ++level){
+        span *= PMAP_FANOUT;
+    }
+    return span;
+}
+
+/**
+ * @param   map         Persistent map.
+ * @param   row         Tile row.
+ * @param   col         Tile column.
+ * @param   slotInLeaf  Index of the tile within its chunk.
+ * @return  index of the tile's chunk in the flat chunk order.
+ * @updates slotInLeaf
+ */
+static long long chunkIndex(const PersistentMap& map, int row, int col, int& slotInLeaf) {
+    slotInLeaf = (row % PMAP_CHUNK) * PMAP_CHUNK + col % PMAP_CHUNK;
+    return static_cast<long long>(row / PMAP_CHUNK) * map.chunkCols + col / PMAP_CHUNK;
+}
+
+/**
+ * Read a tile. Out-of-bounds tiles read as TILE_PILLAR.
+ * @param   map         Persistent map.
+ * @param   row         Tile row.
+ * @param   col         Tile column.
+ * @return  the tile.
+ */
+char tileAt(const PersistentMap& map, int row, int col) {
+    if(row < 0 || col < 0 || row >= map.maxRow || col >= map.maxCol){
+        return TILE_PILLAR;
+    }
+    int tile = 0;
+    long long index = chunkIndex(map, row, col, tile);
+    const PMapNode* node = map.root.get();
+    for(long long span = rootSpan(map); span > 1; span /= PMAP_FANOUT){
+        node = static_cast<const PMapInner*>(node)->children[(index / span) % PMAP_FANOUT].get();
+    }
+    return static_cast<const PMapLeaf*>(node)->chunks[index % PMAP_FANOUT]->tiles[tile];
+}
+
+/**
+ * Copy a node and replace one slot below it, recursing down to the chunk.
+ * @param   node        Node to copy.
+ * @param   span        Chunks covered by one child of the node, 1 for a leaf.
+ * @param   index       Flat chunk index.
+ * @param   tile        Index of the tile within its chunk.
+ * @param   value       New tile.
+ * @return  the copied node.
+ */
+static std::shared_ptr<const PMapNode> copyPath(const PMapNode& node, long long span, long long index, int tile, char value) {
+    int slot = static_cast<int>((index / span) % PMAP_FANOUT);
+    if(span == 1){
+        const PMapLeaf& leaf = static_cast<const PMapLeaf&>(node);
+        std::shared_ptr<PMapLeaf> copy = std::make_shared<PMapLeaf>(leaf);
+        std::shared_ptr<PMapChunk> chunk = std::make_shared<PMapChunk>(*leaf.chunks[slot]);
+        chunk->tiles[tile] = value;
+        copy->chunks[slot] = chunk;
+        return copy;
+    }
+    const PMapInner& inner = static_cast<const PMapInner&>(node);
+    std::shared_ptr<PMapInner> copy = std::make_shared<PMapInner>(inner);
+    copy->children[slot] = copyPath(*inner.children[slot], span / PMAP_FANOUT, index, tile, value);
+    return copy;
+}
+
+/**
+ * Change a tile, making map a new version. Other copies of the old version are unaffected.
+ * @param   map         Persistent map to update.
+ * @param   row         Tile row, must be in bounds.
+ * @param   col         Tile column, must be in bounds.
+ * @param   tile        New tile.
+ * @updates map
+ */
+void setTile(PersistentMap& map, int row, int col, char tile) {
+    if(tileAt(map, row, col) == tile){
+        return;
+    }
+    int slot = 0;
+    long long index = chunkIndex(map, row, col, slot);
+    map.root = copyPath(*map.root, rootSpan(map), index, slot, tile);
+}
+
+/**
+ * Copy a persistent map into a regular 2D map, e.g. for outputMap.
+ * @param   map         Persistent map.
+ * @return  new 2D map array, freed with deleteMap.
+ */
+char** materializeMap(const PersistentMap& map) {
+    char** result = createMap(map.maxRow, map.maxCol);
+    for(int row = 0; row < map.maxRow; ++row){
+        for(int col = 0; col < map.maxCol; ++col){
+            result[row][col] = tileAt(map, row, col);
+        }
+    }
+    return result;
+}
+
+/**
+ * doPlayerMove on a persistent map: same rules and statuses.
+ * @param   map         Persistent map, becomes the new version.
+ * @param   player      Player, moved if possible.
+ * @param   nextRow     Player's next row on the dungeon map (up/down).
+ * @param   nextCol     Player's next column on dungeon map (left/right).
+ * @return  Player's movement status after updating player's position.
+ * @updates map, player
+ */
+int persistentPlayerMove(PersistentMap& map, Player& player, int nextRow, int nextCol) {
+    if(nextRow < 0 || nextCol < 0 || nextRow >= map.maxRow || nextCol >= map.maxCol){
+        return STATUS_STAY;
+    }
+    char target = tileAt(map, nextRow, nextCol);
+    int status = STATUS_STAY;
+    if(target == TILE_EXIT){
+        status = player.treasure != 0 ? STATUS_ESCAPE : STATUS_STAY;
+    } else if(target == TILE_DOOR){
+        status = STATUS_LEAVE;
+    } else if(target == TILE_TREASURE){
+        status = STATUS_TREASURE;
+        player.treasure += 1;
+    } else if(target == TILE_AMULET){
+        status = STATUS_AMULET;
+    } else if(target == TILE_OPEN){
+        status = STATUS_MOVE;
+    }
+    if(status == STATUS_STAY){
+        return STATUS_STAY;
+    }
+    setTile(map, nextRow, nextCol, TILE_PLAYER);
+    setTile(map, player.row, player.col, TILE_OPEN);
+    player.row = nextRow;
+    player.col = nextCol;
+    return status;
+}
+
+/**
+ * doMonsterAttack on a persistent map: every monster in line of sight steps toward the player.
+ * @param   map         Persistent map, becomes the new version.
+ * @param   player      Player.
+ * @return  true if a monster reached the player.
+ * @updates map
+ */
+bool persistentMonsterAttack(PersistentMap& map, const Player& player) {
+    const int stepRow[4] = {-1, 1, 0, 0};
+    const int stepCol[4] = {0, 0, 1, -1};
+    bool eaten = false;
+    for(int ray = 0; ray < 4; ++ray){
+        for(int i = 1; ; ++i){
+            int row = player.row + stepRow[ray] * i;
+            int col = player.col + stepCol[ray] * i;
+            if(row < 0 || col < 0 || row >= map.maxRow || col >= map.maxCol){
+                break;
+            }
+            char tile = tileAt(map, row, col);
+            if(tile == TILE_PILLAR){
+                break;
+            }
+            if(tile == TILE_MONSTER){
+                setTile(map, row, col, TILE_OPEN);
+                setTile(map, row - stepRow[ray], col - stepCol[ray], TILE_MONSTER);
+                eaten = eaten || i == 1;
+            }
+        }
+    }
+    return eaten;
+}
+
+/**
+ * resizeMap on a persistent map: doubles both dimensions, copying the map to the right,
+ * diagonally and below without the player. Builds a new tree; the old version is unaffected.
+ * @param   map         Persistent map, becomes the doubled version.
+ * @return  false if the doubled map would be too large.
+ * @updates map
+ */
+bool persistentResize(PersistentMap& map) {
+    int rows = map.maxRow;
+    int cols = map.maxCol;
+    if(rows <= 0 || cols <= 0 || rows * 2 > (INT32_MAX / (cols * 2))){
+        return false;
+    }
+    char** flat = materializeMap(map);
+    int grownRows = rows;
+    int grownCols = cols;
+    char** grown = resizeMap(flat, grownRows, grownCols);
+    // a copy of a map without listed monsters has none either
+    makePersistentMap(grown, grownRows, grownCols, map);
+    deleteMap(grown, grownRows);
+    return true;
+}
+
+/**
+ * Play one movement or stay command on a branchable state, with the rules of the original
+ * game loop: the player's move, the 'M' monsters in line of sight and the amulet resize.
+ * For maps without listed monsters, which makePersistentMap ensures, this matches stepSession.
+ * @param   state       State to advance; copies made before the call are unaffected.
+ * @param   input       Command character (w, a, s, d or e).
+ * @return  TURN_* outcome of the turn.
+ * @updates state
+ */
+int persistentStep(PersistentState& state, char input) {
+    if(input != MOVE_UP && input != MOVE_LEFT && input != MOVE_DOWN && input != MOVE_RIGHT && input != INPUT_STAY){
+        return TURN_INVALID;
+    }
+    state.total_moves++;
+    if(input == INPUT_STAY){
+        state.status = STATUS_STAY;
+    } else {
+        int nextRow = state.player.row;
+        int nextCol = state.player.col;
+        getDirection(input, nextRow, nextCol);
+        state.status = persistentPlayerMove(state.map, state.player, nextRow, nextCol);
+    }
+    if(state.status == STATUS_ESCAPE){
+        return TURN_ESCAPE;
+    }
+    if(state.status == STATUS_LEAVE){
+        return TURN_LEAVE;
+    }
+    if(persistentMonsterAttack(state.map, state.player)){
+        return TURN_DIED;
+    }
+    if(state.status == STATUS_AMULET && !persistentResize(state.map)){
+        return TURN_ERROR;
+    }
+    return TURN_CONTINUE;
+}
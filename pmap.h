@@ -0,0 +1,64 @@
+#ifndef PMAP_H
+#define PMAP_H
+#include <memory>
+#include "logic.h"
+
+// chunks are PMAP_CHUNK x PMAP_CHUNK tiles; tree nodes have PMAP_FANOUT children
+const int PMAP_CHUNK  = 16;
+const int PMAP_FANOUT = 32;
+
+struct PMapChunk {
+    char tiles[PMAP_CHUNK * PMAP_CHUNK];
+};
+
+// tree node; its kind follows from its level, so nodes carry no tag: the bottom level
+// holds leaves, every level above holds inner nodes
+struct PMapNode {
+};
+
+struct PMapInner : PMapNode {
+    std::shared_ptr<const PMapNode> children[PMAP_FANOUT];
+};
+
+struct PMapLeaf : PMapNode {
+    std::shared_ptr<const PMapChunk> chunks[PMAP_FANOUT];
+};
+
+// immutable map: a shallow tree of immutable chunks. Copying one is O(1) and changing a
+// tile copies only the chunk and the O(log n) nodes above it, so old versions stay valid
+// and share everything else with the new one.
+struct PersistentMap {
+    std::shared_ptr<const PMapNode> root{};
+    int depth = 1;              // node levels above the chunks
+    int maxRow = 0;
+    int maxCol = 0;
+    int chunkCols = 0;          // chunks per map row
+};
+
+// a game state that can be branched freely: copy it and play each copy on its own.
+// Only 'M' monsters are played; maps with listed monsters are not accepted.
+struct PersistentState {
+    PersistentMap map{};
+    Player player{};
+    int total_moves = 0;
+    int status = STATUS_STAY;
+};
+
+// function signatures
+bool makePersistentMap(char** map, int maxRow, int maxCol, PersistentMap& result);
+
+char tileAt(const PersistentMap& map, int row, int col);
+
+void setTile(PersistentMap& map, int row, int col, char tile);
+
+char** materializeMap(const PersistentMap& map);
+
+int persistentPlayerMove(PersistentMap& map, Player& player, int nextRow, int nextCol);
+
+bool persistentMonsterAttack(PersistentMap& map, const Player& player);
+
+bool persistentResize(PersistentMap& map);
+
+int persistentStep(PersistentState& state, char input);
+
+#endif
@@ -0,0 +1,203 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "helper.h"
+#include "latency.h"
+#include "realtime.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+// what a read from stdin found
+const int INPUT_OPEN = 0;
+const int INPUT_CLOSED = 1;
+const int INPUT_QUIT_TYPED = 2;
+
+/**
+ * One real-time tick: play the oldest queued command, or let only the monsters move.
+ * @param   session     Session to advance.
+ * @param   commands    Commands typed since the last tick.
+ * @param   frame       Text to show the player, appended to.
+ * @return  GAME_RUNNING while the game goes on, otherwise the exit code of the game.
+ * @updates session, commands, frame
+ */
+static int playTick(GameSession& session, std::deque<char>& commands, string& frame) {
+    if(!commands.empty()){
+        char input = commands.front();
+        commands.pop_front();
+        return playTurn(session, input, frame);
+    }
+    TurnTimer turnTimer(session.profiler);
+    bool seen = monsterInLine(session);
+    bool eaten = idleSession(session) == TURN_DIED;
+    if(!seen && monsterCount(session.monsters) == 0){
+        return GAME_RUNNING;
+    }
+    PhaseTimer renderTimer(session.profiler, PHASE_RENDER);
+    if(eaten){
+        renderView(frame, session);
+        frame += "You died, adventurer! Better luck next time!\n";
+        renderFootprint(frame, session);
+        return 0;
+    }
+    renderView(frame, session);
+    return GAME_RUNNING;
+}
+
+/**
+ * Queue the commands of one read from stdin. Quitting is answered right away.
+ * @param   commands    Commands waiting for a tick.
+ * @return  INPUT_OPEN, INPUT_CLOSED once stdin reached its end, or INPUT_QUIT_TYPED.
+ * @updates commands
+ */
+static int readCommands(std::deque<char>& commands) {
+    char bytes[256];
+    ssize_t got = read(STDIN_FILENO, bytes, sizeof(bytes));
+    if(got < 0 && (errno == EAGAIN || errno == EINTR)){
+        return INPUT_OPEN;
+    }
+    if(got <= 0){
+        return INPUT_CLOSED;
+    }
+    for(ssize_t b = 0; b < got; ++b){
+        char input = bytes[b];
+        if(input == INPUT_QUIT){
+            cout << "Thank you for playing!" << endl;
+            return INPUT_QUIT_TYPED;
+        }
+        if(input != ' ' && input != '\n' && input != '\r' && input != '\t'){
+            commands.push_back(input);
+        }
+    }
+    return INPUT_OPEN;
+}
+
+/**
+ * Play with monsters moving on a fixed tick instead of waiting for the player.
+ * A timerfd fires tickHz times per second; keys typed in between are queued and one is
+ * played per tick. Quitting takes effect right away, and the game ends like a quit once
+ * the input is closed and every queued command has been played. Tick work is timed against
+ * the tick period so missed deadlines show up in stats.
+ * @param   session     Session with its first room loaded.
+ * @param   tickHz      Ticks per second.
+ * @param   stats       Deadline statistics, filled while playing.
+ * @return  exit code of the game.
+ * @updates session, stats
+ */
+int runRealtime(GameSession& session, int tickHz, TickStats& stats) {
+    if(tickHz <= 0){
+        tickHz = DEFAULT_TICK_HZ;
+    }
+    const long periodNanos = 1000000000L / tickHz;
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    // tv_nsec must stay below one second, so a 1 Hz period goes into tv_sec
+    itimerspec period;
+    std::memset(&period, 0, sizeof(period));
+    period.it_interval.tv_sec = periodNanos / 1000000000L;
+    period.it_interval.tv_nsec = periodNanos % 1000000000L;
+    period.it_value = period.it_interval;
+
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = timerFd;
+    bool armed = timerFd >= 0 && epollFd >= 0 && timerfd_settime(timerFd, 0, &period, nullptr) == 0
+                 && epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event) == 0;
+    event.data.fd = STDIN_FILENO;
+    bool polled = armed && epoll_ctl(epollFd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == 0;
+    // a regular file cannot be polled, but reading it never blocks, so it is queued up front
+    bool fromFile = armed && !polled && errno == EPERM;
+    if(!polled && !fromFile){
+        std::cerr << "Cannot set up the tick timer: " << std::strerror(errno) << endl;
+        if(timerFd >= 0){
+            close(timerFd);
+        }
+        if(epollFd >= 0){
+            close(epollFd);
+        }
+        return 1;
+    }
+
+    std::deque<char> commands;
+    string frame;
+    bool inputClosed = false;
+    int result = GAME_RUNNING;
+    while(fromFile && !inputClosed && result == GAME_RUNNING){
+        int input = readCommands(commands);
+        inputClosed = input == INPUT_CLOSED;
+        result = input == INPUT_QUIT_TYPED ? 0 : GAME_RUNNING;
+    }
+    while(result == GAME_RUNNING){
+        epoll_event ready[2];
+        int count = epoll_wait(epollFd, ready, 2, -1);
+        if(count < 0 && errno != EINTR){
+            result = 1;
+            break;
+        }
+        for(int i = 0; i < count && result == GAME_RUNNING; ++i){
+            if(ready[i].data.fd == STDIN_FILENO){
+                int input = readCommands(commands);
+                if(input == INPUT_CLOSED){
+                    // the game ends once the commands already typed are played
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+                    inputClosed = true;
+                }
+                result = input == INPUT_QUIT_TYPED ? 0 : GAME_RUNNING;
+                continue;
+            }
+
+            uint64_t expirations = 0;
+            if(read(timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)){
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            frame.clear();
+            result = playTick(session, commands, frame);
+            cout << frame << std::flush;
+            if(session.profiler != nullptr && profileRequested()){
+                string report;
+                renderProfile(report, *session.profiler);
+                std::cerr << report << std::flush;
+            }
+            uint64_t spent = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+
+            stats.ticks++;
+            stats.missedTicks += expirations - 1;
+            stats.lateTicks += spent > static_cast<uint64_t>(periodNanos) ? 1 : 0;
+            stats.totalNanos += spent;
+            stats.maxNanos = spent > stats.maxNanos ? spent : stats.maxNanos;
+        }
+        if(result == GAME_RUNNING && inputClosed && commands.empty()){
+            cout << "Thank you for playing!" << endl;
+            result = 0;
+        }
+    }
+    close(timerFd);
+    close(epollFd);
+    return result;
+}
+
+/**
+ * Print how the loop kept up with its deadline.
+ * @param   stats       Statistics from runRealtime.
+ * @param   tickHz      Ticks per second the loop ran at.
+ */
+void printTickStats(const TickStats& stats, int tickHz) {
+    if(stats.ticks == 0){
+        return;
+    }
+    cout << "Ticks: " << stats.ticks << " at " << tickHz << " Hz, "
+         << stats.missedTicks << " missed, " << stats.lateTicks << " over deadline, "
+         << "mean " << stats.totalNanos / stats.ticks / 1000 << " us, "
+         << "max " << stats.maxNanos / 1000 << " us" << endl;
+}
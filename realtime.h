@@ -0,0 +1,22 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+#include <cstdint>
+#include "session.h"
+
+const int DEFAULT_TICK_HZ = 10;
+
+// how well the loop kept its tick deadlines
+struct TickStats {
+    uint64_t ticks = 0;
+    uint64_t missedTicks = 0;   // timer expirations that passed while a tick was still running
+    uint64_t lateTicks = 0;     // ticks whose work took longer than the tick period
+    uint64_t totalNanos = 0;
+    uint64_t maxNanos = 0;
+};
+
+// function signatures
+int runRealtime(GameSession& session, int tickHz, TickStats& stats);
+
+void printTickStats(const TickStats& stats, int tickHz);
+
+#endif
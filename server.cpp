@@ -0,0 +1,622 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "coro.h"
+#include "helper.h"
+#include "journal.h"
+#include "latency.h"
+#include "metrics.h"
+#include "server.h"
+#include "session.h"
+#include "snapshot.h"
+
+using std::string;
+
+// epoll tags for the descriptors that are not client connections
+const uint64_t TAG_LISTEN  = 0;
+const uint64_t TAG_WAKE    = 1;
+const uint64_t TAG_SIGNAL  = 2;
+const uint64_t TAG_METRICS = 3;
+const uint64_t FIRST_CLIENT_ID = 4;
+
+const size_t READ_CHUNK = 4096;
+const size_t MAX_PENDING_INPUT = 64 * 1024;
+
+// turns a client can undo; a cap keeps every connection's journal, and the maps it holds for undo, bounded
+const size_t SERVER_UNDO_TURNS = 32;
+
+// amulets double the map every time; a client whose map grows beyond this many cells is disconnected
+const long long SERVER_MAX_CELLS = 1LL << 20;
+
+// sent before closing a connection whose game ran out of memory or outgrew SERVER_MAX_CELLS
+const char MAP_TOO_LARGE[] = "The dungeon has grown too large for this server, adventurer!\n";
+
+// one client: its game coroutine plus the bytes waiting to be played and to be sent
+struct Connection {
+    uint64_t id = 0;
+    int fd = -1;
+    Journal journal{};
+    GameSession session{};
+    SessionTask task{};
+    Inbox inbox{};              // input the coroutine consumes
+    string frames{};            // text the coroutine rendered since it was last resumed
+    bool busy = false;          // a worker is running the coroutine, which owns everything above
+    bool finished = false;      // game over, close once the output is flushed
+    bool hungUp = false;        // connection broken, drop once no worker owns the session
+    bool inputClosed = false;   // peer shut down its side; the input already received is still played
+    string received{};          // input that arrived while busy
+    string outbox{};            // rendered, not yet written
+    uint32_t watched = EPOLLIN; // epoll events registered for fd
+    size_t mapBytes = 0;        // bytes of the session's map when a worker last gave it back
+};
+
+/**
+ * Check that a dungeon name sent by a client names levels in the server's own directory.
+ * Level files are opened as "<dungeon><room>.txt" and stay in the level cache for good,
+ * so a path would let any client read, and pin, files elsewhere on the server's disk.
+ * @param   dungeon     Dungeon name sent by the client.
+ * @return  true if the name has no path in it.
+ */
+static bool isLocalDungeon(const string& dungeon) {
+    return !dungeon.empty() && dungeon.find('/') == string::npos && dungeon.find("..") == string::npos;
+}
+
+/**
+ * Parse the dungeon line and load the first room. Kept out of playSession so the parsing
+ * state never lives in the coroutine frame, which stays allocated for the whole game.
+ * @param   conn        Connection whose game starts.
+ * @param   request     "<dungeon> <rooms>" line sent by the client.
+ * @return  true if the game is running.
+ */
+static bool startGame(Connection& conn, const string& request) {
+    if(request.empty() && conn.inbox.closed){
+        return false;
+    }
+    std::istringstream line(request);
+    string dungeon;
+    int totalRooms = 0;
+    line >> dungeon >> totalRooms;
+    if(!isLocalDungeon(dungeon)){
+        conn.frames += "There is no such dungeon on this server, adventurer!\n";
+        return false;
+    }
+    try {
+        return beginGame(conn.session, dungeon, totalRooms, conn.frames) == GAME_RUNNING;
+    } catch(const std::bad_alloc&) {
+        conn.frames += MAP_TOO_LARGE;
+        return false;
+    }
+}
+
+/**
+ * Play one command of a connection's game. Running out of memory ends only this game, not
+ * the server, and so does a map grown past SERVER_MAX_CELLS by collecting amulets.
+ * @param   conn        Connection whose game advances.
+ * @param   command     Command character sent by the client.
+ * @return  GAME_RUNNING while the game goes on, otherwise the exit code of the game.
+ */
+static int playCommand(Connection& conn, char command) {
+    try {
+        int result = playTurn(conn.session, command, conn.frames);
+        if(result == GAME_RUNNING && static_cast<long long>(conn.session.maxRow) * conn.session.maxCol > SERVER_MAX_CELLS){
+            conn.frames += MAP_TOO_LARGE;
+            return 1;
+        }
+        return result;
+    } catch(const std::bad_alloc&) {
+        conn.frames += MAP_TOO_LARGE;
+        return 1;
+    }
+}
+
+/**
+ * One game, written as the console loop: wait for the dungeon line, then for each
+ * command play a turn and emit the frame. Suspends whenever the inbox runs dry,
+ * and ends once the inbox is closed and played out.
+ * @param   conn        Connection whose game is played.
+ */
+static SessionTask playSession(Connection& conn) {
+    conn.journal.maxTurns = SERVER_UNDO_TURNS;
+    conn.session.journal = &conn.journal;
+    if(!startGame(conn, co_await nextLine(conn.inbox))){
+        co_return;
+    }
+    while(true){
+        conn.frames += COMMAND_PROMPT;
+        char command = co_await nextCommand(conn.inbox);
+        if(command == INPUT_SAVE){
+            // saves are files on the server's disk, named after whatever dungeon the client sent
+            conn.frames += "Saving is not available on this server, adventurer!\n";
+            continue;
+        }
+        if(command == 0 || playCommand(conn, command) != GAME_RUNNING){
+            co_return;
+        }
+    }
+}
+
+// epoll event loop that owns every connection; workers only ever see busy connections
+class Server {
+public:
+    explicit Server(const ServerConfig& config);
+    ~Server();
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    int run();
+
+private:
+    bool setup();
+    void acceptClients();
+    void readClient(Connection& conn);
+    void writeClient(Connection& conn);
+    void dispatch(Connection& conn);
+    void relocate(uint64_t id);
+    void jobFinished(uint64_t id);
+    void collectFinishedJobs();
+    void watch(Connection& conn);
+    void closeClient(Connection& conn);
+    void maybeClose(Connection& conn);
+    void printMemory();
+    void updateMapBytes(Connection& conn);
+    void writeMetrics();
+
+    ServerConfig config;
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    int signalFd;
+    int metricsFd;
+    uint64_t nextId;
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> clients;    // changed by the loop under sharedLock
+    CoroScheduler scheduler;
+    std::mutex sharedLock;      // guards finishedJobs, and clients against the loop changing it while workers look it up
+    std::vector<uint64_t> finishedJobs;
+    size_t peakSessionBytes;    // largest footprint any closed session reached
+    size_t liveMapBytes;        // sum of every connection's mapBytes
+    uint64_t metricsTurns;      // turns played at the previous metrics write
+    uint64_t metricsNanos;      // time of the previous metrics write
+};
+
+Server::Server(const ServerConfig& config)
+    : config(config), listenFd(-1), epollFd(-1), wakeFd(-1), signalFd(-1), metricsFd(-1), nextId(FIRST_CLIENT_ID),
+      clients(), scheduler(config.workers, [this](uint64_t id) { relocate(id); }, [this](uint64_t id) { jobFinished(id); }),
+      sharedLock(), finishedJobs(), peakSessionBytes(0), liveMapBytes(0), metricsTurns(0), metricsNanos(0) {
+}
+
+Server::~Server() {
+    scheduler.stop();
+    clients.clear();
+    for(int fd : {listenFd, epollFd, wakeFd, signalFd, metricsFd}){
+        if(fd >= 0){
+            close(fd);
+        }
+    }
+    if(!config.socketPath.empty()){
+        unlink(config.socketPath.c_str());
+    }
+}
+
+/**
+ * Open the listening socket, the worker wake-up eventfd and a signalfd for SIGINT/SIGTERM,
+ * and register them all with epoll.
+ * @return  true if every descriptor could be set up.
+ */
+bool Server::setup() {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(config.socketPath.empty() || config.socketPath.size() >= sizeof(address.sun_path)){
+        std::cerr << "Invalid socket path: " << config.socketPath << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, config.socketPath.c_str());
+    unlink(config.socketPath.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+       || listen(listenFd, SOMAXCONN) != 0){
+        std::cerr << "Cannot listen on " << config.socketPath << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(signalFd < 0 || wakeFd < 0 || epollFd < 0){
+        std::cerr << "Cannot set up the event loop: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = TAG_LISTEN;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    event.data.u64 = TAG_WAKE;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    event.data.u64 = TAG_SIGNAL;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event);
+
+    if(!config.metricsPath.empty()){
+        metricsFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(metricsFd < 0){
+            std::cerr << "Cannot set up the metrics timer: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        itimerspec period;
+        std::memset(&period, 0, sizeof(period));
+        period.it_interval.tv_sec = config.metricsSeconds > 0 ? config.metricsSeconds : 1;
+        period.it_value = period.it_interval;
+        timerfd_settime(metricsFd, 0, &period, nullptr);
+        event.data.u64 = TAG_METRICS;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, metricsFd, &event);
+        startMetrics();
+        metricsNanos = monotonicNanos();
+    }
+    return true;
+}
+
+/**
+ * Serve until SIGINT or SIGTERM.
+ * @return  exit code.
+ */
+int Server::run() {
+    if(!setup()){
+        return 1;
+    }
+    std::cout << "Serving dungeons on " << config.socketPath << " with " << scheduler.size() << " workers" << std::endl;
+
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    while(true){
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if(ready < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        for(int i = 0; i < ready; ++i){
+            uint64_t tag = events[i].data.u64;
+            if(tag == TAG_SIGNAL){
+                std::cout << "Shutting down with " << clients.size() << " open sessions" << std::endl;
+                printMemory();
+                writeMetrics();
+                return 0;
+            }
+            if(tag == TAG_METRICS){
+                uint64_t expirations = 0;
+                ssize_t ignored = read(metricsFd, &expirations, sizeof(expirations));
+                (void)ignored;
+                writeMetrics();
+                continue;
+            }
+            if(tag == TAG_LISTEN){
+                acceptClients();
+                continue;
+            }
+            if(tag == TAG_WAKE){
+                collectFinishedJobs();
+                continue;
+            }
+            auto found = clients.find(tag);
+            if(found == clients.end()){
+                continue;
+            }
+            Connection& conn = *found->second;
+            if(events[i].events & (EPOLLERR | EPOLLHUP)){
+                conn.hungUp = true;
+            }
+            if(events[i].events & EPOLLOUT){
+                writeClient(conn);
+            }
+            if(events[i].events & EPOLLIN){
+                readClient(conn);
+            }
+            maybeClose(conn);
+        }
+    }
+}
+
+void Server::acceptClients() {
+    while(true){
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0){
+            return;
+        }
+        if(clients.size() >= static_cast<size_t>(config.maxClients)){
+            close(fd);
+            continue;
+        }
+        std::unique_ptr<Connection> conn(new Connection());
+        conn->id = nextId++;
+        conn->fd = fd;
+        conn->outbox = "Please enter the dungeon name and number of levels: ";
+        conn->task = playSession(*conn);
+
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u64 = conn->id;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        Connection& added = *conn;
+        {
+            std::lock_guard<std::mutex> guard(sharedLock);
+            clients[conn->id] = std::move(conn);
+        }
+        writeClient(added);
+    }
+}
+
+void Server::readClient(Connection& conn) {
+    char chunk[READ_CHUNK];
+    while(true){
+        ssize_t got = read(conn.fd, chunk, sizeof(chunk));
+        if(got > 0){
+            if(!conn.finished && conn.received.size() < MAX_PENDING_INPUT){
+                conn.received.append(chunk, static_cast<size_t>(got));
+            }
+            continue;
+        }
+        if(got == 0){
+            // half-closed: play out what was sent, then close once the game ends
+            conn.inputClosed = true;
+            watch(conn);
+        } else if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+            conn.hungUp = true;
+        }
+        break;
+    }
+    dispatch(conn);
+}
+
+void Server::writeClient(Connection& conn) {
+    while(!conn.outbox.empty()){
+        ssize_t sent = send(conn.fd, conn.outbox.data(), conn.outbox.size(), MSG_NOSIGNAL);
+        if(sent < 0){
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                break;
+            }
+            if(errno == EINTR){
+                continue;
+            }
+            conn.hungUp = true;
+            conn.outbox.clear();
+            break;
+        }
+        conn.outbox.erase(0, static_cast<size_t>(sent));
+    }
+    watch(conn);
+}
+
+/**
+ * Move the bytes received meanwhile into the coroutine's inbox, close the inbox if the peer
+ * shut down its side, and resume the coroutine on a worker, unless a worker already runs it.
+ * @param   conn        Connection with new input.
+ */
+void Server::dispatch(Connection& conn) {
+    if(conn.busy || conn.finished || conn.hungUp){
+        return;
+    }
+    bool closing = conn.inputClosed && !conn.inbox.closed;
+    if(conn.received.empty() && !closing){
+        return;
+    }
+    conn.inbox.append(conn.received.data(), conn.received.size());
+    conn.received.clear();
+    conn.inbox.closed = conn.inputClosed;
+    // before the first room is loaded the coroutine waits for a whole dungeon line, afterwards for a command
+    bool waitingForDungeon = conn.session.map == nullptr;
+    if(!conn.inbox.closed && (waitingForDungeon ? !conn.inbox.hasLine() : !conn.inbox.hasCommand())){
+        return;
+    }
+    conn.busy = true;
+    scheduler.schedule(conn.id, conn.task.coroutine());
+}
+
+/**
+ * Called on a session's new worker before it runs there for the first time.
+ * The connection is busy, so the worker owns its session.
+ * @param   id          Connection id.
+ */
+void Server::relocate(uint64_t id) {
+    Connection* conn = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(sharedLock);
+        auto found = clients.find(id);
+        conn = found == clients.end() ? nullptr : found->second.get();
+    }
+    if(conn != nullptr){
+        relocateMap(conn->session);
+    }
+}
+
+/**
+ * Called on the worker once a coroutine suspended again; hands the connection back to the loop.
+ * @param   id          Connection id.
+ */
+void Server::jobFinished(uint64_t id) {
+    {
+        std::lock_guard<std::mutex> guard(sharedLock);
+        finishedJobs.push_back(id);
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+/**
+ * Take back connections whose coroutines suspended, queue their frames and dispatch any input that arrived meanwhile.
+ */
+void Server::collectFinishedJobs() {
+    uint64_t count = 0;
+    ssize_t ignored = read(wakeFd, &count, sizeof(count));
+    (void)ignored;
+
+    std::vector<uint64_t> done;
+    {
+        std::lock_guard<std::mutex> guard(sharedLock);
+        done.swap(finishedJobs);
+    }
+    for(uint64_t id : done){
+        auto found = clients.find(id);
+        if(found == clients.end()){
+            continue;
+        }
+        Connection& conn = *found->second;
+        conn.busy = false;
+        updateMapBytes(conn);
+        conn.finished = conn.task.done();
+        conn.outbox += conn.frames;
+        conn.frames.clear();
+        writeClient(conn);
+        dispatch(conn);
+        maybeClose(conn);
+    }
+}
+
+/**
+ * Watch the socket for input until the peer shut down its side, and for writability while output is queued.
+ * @param   conn        Connection to watch.
+ */
+void Server::watch(Connection& conn) {
+    uint32_t wanted = 0;
+    if(!conn.inputClosed){
+        wanted |= EPOLLIN;
+    }
+    if(!conn.outbox.empty()){
+        wanted |= EPOLLOUT;
+    }
+    if(conn.watched == wanted || conn.fd < 0){
+        return;
+    }
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = wanted;
+    event.data.u64 = conn.id;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &event);
+    conn.watched = wanted;
+}
+
+/**
+ * Drop a connection that hung up or whose game is over and fully sent,
+ * unless a worker still owns its session.
+ * @param   conn        Connection to check; may be destroyed.
+ */
+void Server::maybeClose(Connection& conn) {
+    if(conn.busy){
+        return;
+    }
+    if(conn.hungUp || (conn.finished && conn.outbox.empty())){
+        closeClient(conn);
+    }
+}
+
+void Server::closeClient(Connection& conn) {
+    peakSessionBytes = conn.session.peakBytes > peakSessionBytes ? conn.session.peakBytes : peakSessionBytes;
+    liveMapBytes -= conn.mapBytes;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+    close(conn.fd);
+    scheduler.forget(conn.id);
+    std::lock_guard<std::mutex> guard(sharedLock);
+    clients.erase(conn.id);
+}
+
+/**
+ * Print what the open sessions hold and the largest footprint a session reached.
+ * Sessions a worker is playing right now are skipped, as their state is changing.
+ */
+void Server::printMemory() {
+    size_t openBytes = 0;
+    size_t openMapBytes = 0;
+    size_t peakBytes = peakSessionBytes;
+    size_t measured = 0;
+    std::lock_guard<std::mutex> guard(sharedLock);
+    for(const auto& entry : clients){
+        const Connection& conn = *entry.second;
+        if(conn.busy){
+            continue;
+        }
+        SessionFootprint footprint = sessionFootprint(conn.session);
+        openBytes += footprint.totalBytes;
+        openMapBytes += footprint.mapBytes;
+        peakBytes = conn.session.peakBytes > peakBytes ? conn.session.peakBytes : peakBytes;
+        measured++;
+    }
+    std::cout << measured << " idle sessions hold " << openBytes << " bytes, " << openMapBytes << " of them in maps; "
+              << "the largest session peaked at " << peakBytes << " bytes" << std::endl;
+}
+
+/**
+ * Refresh the map bytes counted for a session a worker just gave back.
+ * @param   conn        Connection whose session is idle.
+ */
+void Server::updateMapBytes(Connection& conn) {
+    size_t bytes = conn.session.map == nullptr ? 0 : mapBytes(conn.session.maxRow, conn.session.maxCol);
+    liveMapBytes = liveMapBytes - conn.mapBytes + bytes;
+    conn.mapBytes = bytes;
+}
+
+/**
+ * Rewrite the metrics file: the workers' counters plus the gauges only the event loop knows.
+ */
+void Server::writeMetrics() {
+    if(config.metricsPath.empty()){
+        return;
+    }
+    uint64_t now = monotonicNanos();
+    uint64_t turns = metricTotal(METRIC_TURNS);
+    MetricsGauges gauges;
+    gauges.activeSessions = clients.size();
+    gauges.mapBytes = liveMapBytes;
+    if(now > metricsNanos){
+        gauges.turnsPerSecond = static_cast<double>(turns - metricsTurns) * 1e9 / static_cast<double>(now - metricsNanos);
+    }
+    metricsTurns = turns;
+    metricsNanos = now;
+
+    string text;
+    renderMetrics(text, gauges);
+    if(!writeMetricsFile(config.metricsPath, text)){
+        std::cerr << "Cannot write metrics to " << config.metricsPath << ": " << std::strerror(errno) << std::endl;
+    }
+}
+
+/**
+ * Serve games over a Unix domain socket until SIGINT or SIGTERM.
+ * Each connection first sends "<dungeon> <rooms>" on one line, then command characters;
+ * it gets back the same text the console game prints. Every game runs as a coroutine
+ * (playSession) that only holds a small frame while it waits for input.
+ * @param   config      Socket path and worker count.
+ * @return  exit code.
+ */
+int runServer(const ServerConfig& config) {
+    // block the shutdown signals before any worker starts so only the signalfd sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    Server server(config);
+    return server.run();
+}
@@ -0,0 +1,16 @@
+#ifndef SERVER_H
+#define SERVER_H
+#include <string>
+
+struct ServerConfig {
+    std::string socketPath{};
+    int workers = 0;            // threads that play turns, 0 for one per usable core
+    int maxClients = 4096;      // connections beyond this are refused
+    std::string metricsPath{};  // Prometheus text file rewritten every metricsSeconds, empty for none
+    int metricsSeconds = 5;
+};
+
+// function signatures
+int runServer(const ServerConfig& config);
+
+#endif
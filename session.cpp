@@ -0,0 +1,593 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "alloc.h"
+#include "journal.h"
+#include "latency.h"
+#include "metrics.h"
+#include "perfcounters.h"
+#include "session.h"
+#include "trace.h"
+
+using std::string;
+
+GameSession::GameSession()
+    : dungeon(), total_rooms(0), current_room(0), map(nullptr), maxRow(0), maxCol(0),
+      player(), total_moves(0), status(STATUS_STAY), loadError(LEVEL_OK), journal(nullptr), profiler(nullptr), flow(), monsters(), entities(), fog(),
+      levelBytes(0), peakMapBytes(0), peakBytes(0) {
+}
+
+GameSession::~GameSession() {
+    endSession(*this);
+}
+
+/**
+ * Build the level file name for a room of a dungeon, e.g. "easy" and 2 give "easy2.txt".
+ * @param   dungeon     Dungeon name entered by the user.
+ * @param   room        Room number, starting at 1.
+ * @return  file name of the room's level.
+ */
+string roomFileName(const string& dungeon, int room) {
+    return dungeon + std::to_string(room) + ".txt";
+}
+
+/**
+ * Look up a level in the process-wide level cache, reading it with readLevelFile on first use.
+ * Templates are never evicted, so the returned pointer stays valid for the whole run.
+ * Failed loads are not cached, so a missing file is retried every time it is requested.
+ * @param   fileName    File name of dungeon level.
+ * @param   error       Optional LEVEL_* result of the lookup.
+ * @return  pointer to the cached level, or nullptr if the level could not be loaded.
+ * @updates error
+ */
+const LevelTemplate* cachedLevel(const string& fileName, int* error) {
+    static std::mutex cacheLock;
+    static std::map<string, LevelTemplate> cache;
+
+    std::lock_guard<std::mutex> guard(cacheLock);
+    auto found = cache.find(fileName);
+    if(found != cache.end()){
+        countMetric(METRIC_LEVEL_CACHE_HITS);
+        if(error != nullptr){
+            *error = LEVEL_OK;
+        }
+        return &found->second;
+    }
+
+    countMetric(METRIC_LEVEL_CACHE_MISSES);
+    LevelTemplate level;
+    int result = readLevelFile(fileName, level);
+    if(error != nullptr){
+        *error = result;
+    }
+    if(result != LEVEL_OK){
+        return nullptr;
+    }
+    LevelTemplate& cached = cache[fileName];
+    cached = std::move(level);
+    return &cached;
+}
+
+/**
+ * Skip spaces, tabs and line breaks.
+ * @param   text        Level text.
+ * @param   length      Length of the level text.
+ * @param   pos         Read position.
+ * @updates pos
+ */
+static void skipSpace(const char* text, size_t length, size_t& pos) {
+    while(pos < length && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'
+                           || text[pos] == '\v' || text[pos] == '\f')){
+        pos++;
+    }
+}
+
+/**
+ * Read one whitespace-separated integer.
+ * @param   text        Level text.
+ * @param   length      Length of the level text.
+ * @param   pos         Read position.
+ * @param   value       Parsed value.
+ * @return  false if there is no integer at the read position.
+ * @updates pos, value
+ */
+static bool readInt(const char* text, size_t length, size_t& pos, int& value) {
+    skipSpace(text, length, pos);
+    bool negative = false;
+    if(pos < length && (text[pos] == '-' || text[pos] == '+')){
+        negative = text[pos] == '-';
+        pos++;
+    }
+    if(pos >= length || text[pos] < '0' || text[pos] > '9'){
+        return false;
+    }
+    long long parsed = 0;
+    while(pos < length && text[pos] >= '0' && text[pos] <= '9'){
+        parsed = parsed * 10 + (text[pos] - '0');
+        if(parsed > INT32_MAX){
+            return false;
+        }
+        pos++;
+    }
+    value = static_cast<int>(negative ? -parsed : parsed);
+    return true;
+}
+
+/**
+ * Parse a level from memory, with the same format and validation as loadLevel
+ * but without streams, so it can be used on buffers handed over by embedders.
+ * @param   text        Level text: rows, columns, player row, player column, then the tiles.
+ * @param   length      Length of the level text.
+ * @param   level       Parsed level.
+ * @return  true if the level is valid.
+ * @updates level
+ */
+bool parseLevel(const char* text, size_t length, LevelTemplate& level) {
+    size_t pos = 0;
+    int maxRow = 0;
+    int maxCol = 0;
+    int startRow = 0;
+    int startCol = 0;
+    if(!readInt(text, length, pos, maxRow) || !readInt(text, length, pos, maxCol)){
+        return false;
+    }
+    if(maxRow <= 0 || maxCol <= 0 || maxRow > (INT32_MAX / maxCol) || maxRow * maxCol <= 1){
+        return false;
+    }
+    if(!readInt(text, length, pos, startRow) || !readInt(text, length, pos, startCol)){
+        return false;
+    }
+    if(startRow < 0 || startCol < 0 || startRow >= maxRow || startCol >= maxCol){
+        return false;
+    }
+
+    std::vector<char> tiles(static_cast<size_t>(maxRow) * maxCol);
+    bool hasDoor = false;
+    bool hasExit = false;
+    size_t cell = 0;
+    for(int row = 0; row < maxRow; ++row){
+        for(int col = 0; col < maxCol; ++col, ++cell){
+            skipSpace(text, length, pos);
+            if(pos >= length){
+                return false;
+            }
+            char spot = text[pos++];
+            if(row == startRow && col == startCol){
+                tiles[cell] = TILE_PLAYER;
+                continue;
+            }
+            if(spot != TILE_TREASURE && spot != TILE_PILLAR && spot != TILE_OPEN && spot != TILE_AMULET
+               && !isMonsterTile(spot) && spot != TILE_DOOR && spot != TILE_EXIT){
+                return false;
+            }
+            hasDoor = hasDoor || spot == TILE_DOOR;
+            hasExit = hasExit || spot == TILE_EXIT;
+            tiles[cell] = spot;
+        }
+    }
+    skipSpace(text, length, pos);
+    if(pos != length || (!hasDoor && !hasExit)){
+        return false;
+    }
+
+    level.maxRow = maxRow;
+    level.maxCol = maxCol;
+    level.startRow = startRow;
+    level.startCol = startCol;
+    level.tiles.swap(tiles);
+    return true;
+}
+
+/**
+ * Read a level file in one go and parse it with parseLevel.
+ * @param   fileName    File name of dungeon level.
+ * @param   level       Parsed level.
+ * @return  LEVEL_OK, LEVEL_NOT_OPEN if the file cannot be opened or read, LEVEL_INVALID if it is not a valid level.
+ * @updates level
+ */
+int readLevelFile(const string& fileName, LevelTemplate& level) {
+    TraceSpan span("readLevelFile");
+    std::FILE* file = std::fopen(fileName.c_str(), "rb");
+    if(file == nullptr){
+        return LEVEL_NOT_OPEN;
+    }
+    std::vector<char> text;
+    char chunk[4096];
+    size_t got = 0;
+    while((got = std::fread(chunk, 1, sizeof(chunk), file)) > 0){
+        text.insert(text.end(), chunk, chunk + got);
+    }
+    bool readError = std::ferror(file) != 0;
+    std::fclose(file);
+    if(readError){
+        return LEVEL_NOT_OPEN;
+    }
+    return parseLevel(text.data(), text.size(), level) ? LEVEL_OK : LEVEL_INVALID;
+}
+
+/**
+ * Start a new game in the first room of a dungeon.
+ * @param   session     Session to (re)initialize; any previous map is released.
+ * @param   dungeon     Dungeon name, level files are named <dungeon><room>.txt.
+ * @param   totalRooms  Number of rooms in the dungeon.
+ * @return  true if the first room was loaded.
+ * @updates session
+ */
+bool startSession(GameSession& session, const string& dungeon, int totalRooms) {
+    session.dungeon = dungeon;
+    session.total_rooms = totalRooms;
+    session.total_moves = 0;
+    session.status = STATUS_STAY;
+    session.player.treasure = 0;
+    session.peakMapBytes = 0;
+    session.peakBytes = 0;
+    return enterRoom(session, 1);
+}
+
+/**
+ * Load the given room of the session's dungeon and place the player at its start.
+ * The player's treasure and the move counter carry over between rooms.
+ * @param   session     Session to update.
+ * @param   room        Room number to enter, starting at 1.
+ * @return  true if the room was loaded, false if the level file is missing or invalid.
+ * @updates session
+ */
+bool enterRoom(GameSession& session, int room) {
+    TraceSpan span("loadLevel");
+    CounterScope counted(COUNTED_LOAD);
+    AllocationSite site(ALLOC_LOAD_LEVEL);
+    countMetric(METRIC_LEVEL_LOADS);
+    endSession(session);
+    session.current_room = room;
+
+    const LevelTemplate* level = cachedLevel(roomFileName(session.dungeon, room), &session.loadError);
+    if(level == nullptr){
+        return false;
+    }
+    return enterLevel(session, *level);
+}
+
+/**
+ * Replace the current map with a fresh copy of a parsed level and place the player at its start.
+ * @param   session     Session to update; dungeon and room bookkeeping are left alone.
+ * @param   level       Level to copy.
+ * @return  true if the map could be allocated.
+ * @updates session
+ */
+bool enterLevel(GameSession& session, const LevelTemplate& level) {
+    endSession(session);
+    if(session.journal != nullptr){
+        clearJournal(*session.journal);
+    }
+    {
+        AllocationSite site(ALLOC_CREATE_MAP);
+        session.map = createMap(level.maxRow, level.maxCol);
+    }
+    if(session.map == nullptr){
+        return false;
+    }
+    session.maxRow = level.maxRow;
+    session.maxCol = level.maxCol;
+    for(int row = 0; row < level.maxRow; ++row){
+        std::memcpy(session.map[row], &level.tiles[static_cast<size_t>(row) * level.maxCol], level.maxCol);
+    }
+    session.player.row = level.startRow;
+    session.player.col = level.startCol;
+    session.levelBytes = level.tiles.capacity();
+    notePeakFootprint(session);
+    return true;
+}
+
+/**
+ * @param   session     Session to check.
+ * @return  true if the dungeon has a room after the current one.
+ */
+bool hasNextRoom(const GameSession& session) {
+    return session.current_room < session.total_rooms;
+}
+
+/**
+ * Copy the map into a fresh allocation made by the calling thread. Used after a session moved
+ * to another worker, so its map is first touched by, and placed on the memory node of, the new core.
+ * @param   session     Session whose map is moved.
+ * @updates session
+ */
+void relocateMap(GameSession& session) {
+    if(session.map == nullptr){
+        return;
+    }
+    char** moved = nullptr;
+    {
+        AllocationSite site(ALLOC_CREATE_MAP);
+        moved = createMap(session.maxRow, session.maxCol);
+    }
+    for(int row = 0; row < session.maxRow; ++row){
+        std::memcpy(moved[row], session.map[row], session.maxCol);
+    }
+    int rows = session.maxRow;
+    deleteMap(session.map, rows);
+    session.map = moved;
+}
+
+/**
+ * Collect the 'M' monsters on the player's row and column, the only ones doMonsterAttack can move.
+ * @param   session     Session to look at.
+ * @param   inLine      Positions of the monsters found.
+ * @updates session, inLine
+ */
+static void collectInLine(GameSession& session, std::vector<SpatialEntry>& inLine) {
+    SpatialGrid& grid = session.entities;
+    syncSpatialGrid(grid, session.map, session.maxRow, session.maxCol);
+    const std::vector<SpatialEntry>& onRow = entitiesOnRow(grid, session.player.row, 0, session.maxCol - 1, TILE_MONSTER);
+    inLine.assign(onRow.begin(), onRow.end());
+    const std::vector<SpatialEntry>& onColumn = entitiesOnColumn(grid, session.player.col, 0, session.maxRow - 1, TILE_MONSTER);
+    inLine.insert(inLine.end(), onColumn.begin(), onColumn.end());
+}
+
+/**
+ * @param   session     Session to look at.
+ * @return  true if an 'M' monster shares the player's row or column, so it may move this turn.
+ * @updates session
+ */
+bool monsterInLine(GameSession& session) {
+    static thread_local std::vector<SpatialEntry> inLine;
+    collectInLine(session, inLine);
+    return !inLine.empty();
+}
+
+/**
+ * Move the monsters that see the player, then the listed ones, recording the touched cells
+ * if the session keeps a journal. The ray scans of doMonsterAttack are skipped when the
+ * spatial grid has no 'M' on the player's row or column, which on large sparse maps is most turns.
+ * @param   session     Session whose monsters move.
+ * @return  true if the player was caught.
+ * @updates session
+ */
+static bool moveMonsters(GameSession& session) {
+    static thread_local std::vector<SpatialEntry> inLine;
+    collectInLine(session, inLine);
+    if(!inLine.empty()){
+        if(session.journal != nullptr){
+            recordMonsterAttack(*session.journal, session.map, session.maxRow, session.maxCol, session.player);
+        }
+        bool eaten = false;
+        {
+            CounterScope counted(COUNTED_MONSTER_ATTACK);
+            eaten = doMonsterAttack(session.map, session.maxRow, session.maxCol, session.player);
+        }
+
+        // every one of them is still in place or one step closer to the player
+        SpatialGrid& grid = session.entities;
+        for(const SpatialEntry& entry : inLine){
+            removeEntity(grid, entry.row, entry.col);
+        }
+        for(const SpatialEntry& entry : inLine){
+            int stepRow = (session.player.row > entry.row) - (session.player.row < entry.row);
+            int stepCol = (session.player.col > entry.col) - (session.player.col < entry.col);
+            for(int step = 0; step <= 1; ++step){
+                int row = entry.row + step * stepRow;
+                int col = entry.col + step * stepCol;
+                if(session.map[row][col] == TILE_MONSTER){
+                    removeEntity(grid, row, col);
+                    addEntity(grid, row, col);
+                }
+            }
+        }
+        if(eaten){
+            return true;
+        }
+    }
+    return updateMonsters(session.monsters, session.flow, session.map, session.maxRow, session.maxCol, session.player, session.journal);
+}
+
+/**
+ * Apply the rules of one valid command, recording the touched cells if the session keeps a journal.
+ * @param   session     Session to advance.
+ * @param   input       Movement or stay command.
+ * @return  TURN_* outcome of the turn.
+ * @updates session
+ */
+static int applyTurn(GameSession& session, char input) {
+    Journal* journal = session.journal;
+    session.total_moves++;
+    if(input == INPUT_STAY){
+        session.status = STATUS_STAY;
+    } else {
+        PhaseTimer timer(session.profiler, PHASE_MOVE);
+        int nextRow = session.player.row;
+        int nextCol = session.player.col;
+        getDirection(input, nextRow, nextCol);
+        if(journal != nullptr){
+            recordPlayerMove(*journal, session.map, session.maxRow, session.maxCol, session.player, nextRow, nextCol);
+        }
+        CounterScope counted(COUNTED_PLAYER_MOVE);
+        session.status = doPlayerMove(session.map, session.maxRow, session.maxCol, session.player, nextRow, nextCol);
+    }
+
+    if(session.status == STATUS_ESCAPE){
+        return TURN_ESCAPE;
+    }
+    if(session.status == STATUS_LEAVE){
+        return TURN_LEAVE;
+    }
+    bool caught = false;
+    {
+        PhaseTimer timer(session.profiler, PHASE_MONSTERS);
+        caught = moveMonsters(session);
+    }
+    if(caught){
+        return TURN_DIED;
+    }
+    if(session.status != STATUS_AMULET){
+        return TURN_CONTINUE;
+    }
+    PhaseTimer timer(session.profiler, PHASE_RESIZE);
+
+    // resize into copies of the dimensions so the session stays consistent if allocation throws
+    int newRow = session.maxRow;
+    int newCol = session.maxCol;
+    char** grown = nullptr;
+    CounterScope counted(COUNTED_RESIZE);
+    AllocationSite site(ALLOC_RESIZE_MAP);
+    countMetric(METRIC_RESIZES);
+    if(journal != nullptr){
+        // keep the old map for undo instead of letting resizeMap free it
+        grown = growMap(session.map, newRow, newCol);
+        if(grown != nullptr){
+            recordResize(*journal, session.map, session.maxRow, session.maxCol);
+            newRow *= 2;
+            newCol *= 2;
+        } else {
+            clearJournal(*journal);
+            deleteMap(session.map, newRow);
+        }
+    } else {
+        grown = resizeMap(session.map, newRow, newCol);
+    }
+    session.map = grown;
+    if(grown == nullptr){
+        // the old map is already released
+        session.maxRow = 0;
+        session.maxCol = 0;
+        return TURN_ERROR;
+    }
+    session.maxRow = newRow;
+    session.maxCol = newCol;
+    return TURN_CONTINUE;
+}
+
+/**
+ * Play one turn: move the player, move the monsters and use an amulet if one was picked up.
+ * Mirrors the order of the original game loop, so a monster can still catch the player
+ * on the turn an amulet is collected, before the map grows.
+ * @param   session     Session to advance.
+ * @param   input       Command character (w, a, s, d, e or q).
+ * @return  TURN_* outcome of the turn; session.status holds the player's STATUS_* flag.
+ * @updates session
+ */
+int stepSession(GameSession& session, char input) {
+    TurnTimer turnTimer(session.profiler);
+    {
+        PhaseTimer timer(session.profiler, PHASE_INPUT);
+        if(input == INPUT_QUIT){
+            return TURN_QUIT;
+        }
+        if(input != MOVE_UP && input != MOVE_LEFT && input != MOVE_DOWN && input != MOVE_RIGHT && input != INPUT_STAY){
+            return TURN_INVALID;
+        }
+    }
+    if(session.journal != nullptr){
+        beginTurn(*session.journal, session);
+    }
+    int turn = applyTurn(session, input);
+    if(session.journal != nullptr){
+        endTurn(*session.journal, session);
+    }
+    notePeakFootprint(session);
+    return turn;
+}
+
+/**
+ * Let only the monsters move, for a tick on which the player gave no command.
+ * Does not count as a move; the journal folds what the monsters changed into the last turn
+ * and forgets ticks that changed nothing (see endIdleTick).
+ * @param   session     Session to advance.
+ * @return  TURN_DIED if the player was caught, otherwise TURN_CONTINUE.
+ * @updates session
+ */
+int idleSession(GameSession& session) {
+    TurnTimer turnTimer(session.profiler);
+    size_t mark = 0;
+    if(session.journal != nullptr){
+        mark = beginIdleTick(*session.journal, session);
+    }
+    bool caught = false;
+    {
+        PhaseTimer timer(session.profiler, PHASE_MONSTERS);
+        caught = moveMonsters(session);
+    }
+    if(session.journal != nullptr){
+        endIdleTick(*session.journal, session, mark);
+    }
+    notePeakFootprint(session);
+    return caught ? TURN_DIED : TURN_CONTINUE;
+}
+
+/**
+ * Release the session's map.
+ * @param   session     Session to clean up.
+ * @updates session
+ */
+void endSession(GameSession& session) {
+    deleteMap(session.map, session.maxRow);
+    session.maxCol = 0;
+    session.levelBytes = 0;
+    resetFlowField(session.flow);
+    resetMonsters(session.monsters);
+    resetSpatialGrid(session.entities);
+    resetFog(session.fog);
+}
+
+/**
+ * @param   maxRow      Number of rows of a map.
+ * @param   maxCol      Number of columns of a map.
+ * @return  bytes createMap allocates for it: the row pointers and the rows.
+ */
+size_t mapBytes(int maxRow, int maxCol) {
+    if(maxRow <= 0 || maxCol <= 0){
+        return 0;
+    }
+    return static_cast<size_t>(maxRow) * (sizeof(char*) + static_cast<size_t>(maxCol));
+}
+
+/**
+ * @return  bytes held by a vector's buffer.
+ */
+template <typename T>
+static size_t vectorBytes(const std::vector<T>& values) {
+    return values.capacity() * sizeof(T);
+}
+
+/**
+ * Measure what a session holds right now. Counts allocated capacity, not what is in use.
+ * Costs O(1): the spatial grid and the journal keep their variable sizes up to date, so
+ * the high-water marks can be raised after every turn.
+ * @param   session     Session to measure.
+ * @return  bytes by kind.
+ */
+SessionFootprint sessionFootprint(const GameSession& session) {
+    SessionFootprint footprint;
+    footprint.mapBytes = session.map == nullptr ? 0 : mapBytes(session.maxRow, session.maxCol);
+    footprint.levelBytes = session.levelBytes;
+
+    const FlowField& flow = session.flow;
+    const MonsterList& monsters = session.monsters;
+    const SpatialGrid& entities = session.entities;
+    size_t indexBytes = vectorBytes(flow.dist) + vectorBytes(flow.open) + vectorBytes(flow.queue);
+    indexBytes += vectorBytes(monsters.row) + vectorBytes(monsters.col) + vectorBytes(monsters.type)
+                  + vectorBytes(monsters.speed) + vectorBytes(monsters.state) + vectorBytes(monsters.order);
+    indexBytes += vectorBytes(entities.buckets) + vectorBytes(entities.found) + entities.entryBytes;
+    indexBytes += vectorBytes(session.fog.explored) + vectorBytes(session.fog.visible)
+                  + (session.fog.view.empty() ? 0 : session.fog.view.capacity());
+    footprint.indexBytes = indexBytes;
+
+    footprint.journalBytes = session.journal == nullptr ? 0 : journalBytes(*session.journal);
+    footprint.totalBytes = footprint.mapBytes + footprint.levelBytes + footprint.indexBytes + footprint.journalBytes;
+    return footprint;
+}
+
+/**
+ * Raise the session's high-water marks to its current footprint.
+ * @param   session     Session to measure.
+ * @updates session
+ */
+void notePeakFootprint(GameSession& session) {
+    SessionFootprint footprint = sessionFootprint(session);
+    session.peakMapBytes = footprint.mapBytes > session.peakMapBytes ? footprint.mapBytes : session.peakMapBytes;
+    session.peakBytes = footprint.totalBytes > session.peakBytes ? footprint.totalBytes : session.peakBytes;
+}
@@ -0,0 +1,108 @@
+#ifndef SESSION_H
+#define SESSION_H
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "flowfield.h"
+#include "fog.h"
+#include "logic.h"
+#include "monsters.h"
+#include "spatial.h"
+
+// outcomes of a single turn, returned by stepSession
+const int TURN_INVALID  = -1;   // command not understood, nothing happened
+const int TURN_CONTINUE = 0;    // turn played, the game goes on
+const int TURN_QUIT     = 1;    // player abandoned the quest
+const int TURN_LEAVE    = 2;    // player went through a door to the next room
+const int TURN_ESCAPE   = 3;    // player went through the dungeon exit
+const int TURN_DIED     = 4;    // a monster reached the player
+const int TURN_ERROR    = 5;    // the map could not be resized
+
+// results of reading a level file
+const int LEVEL_OK       = 0;
+const int LEVEL_NOT_OPEN = 1;   // file missing or unreadable
+const int LEVEL_INVALID  = 2;   // file read but not a valid level
+
+// parsed level file, kept so a room can be re-entered without reading the file again
+struct LevelTemplate {
+    int maxRow = 0;
+    int maxCol = 0;
+    int startRow = 0;
+    int startCol = 0;
+    std::vector<char> tiles{};  // maxRow * maxCol tiles, row-major, player tile included
+};
+
+// bytes a session holds, by kind
+struct SessionFootprint {
+    size_t mapBytes = 0;        // live map: row pointers and rows
+    size_t levelBytes = 0;      // level template the room came from, shared through the level cache
+    size_t indexBytes = 0;      // flow field, monster list, spatial grid and fog
+    size_t journalBytes = 0;    // undo history, including maps kept for undo
+    size_t totalBytes = 0;
+};
+
+struct Journal;
+struct TurnProfiler;
+
+// all state of one game, from the first room of a dungeon to the exit
+struct GameSession {
+    std::string dungeon;
+    int total_rooms;
+    int current_room;
+    char** map;
+    int maxRow;
+    int maxCol;
+    Player player;
+    int total_moves;
+    int status;                 // STATUS_* of the last played turn
+    int loadError;              // LEVEL_* result of the last room load
+    Journal* journal;           // optional undo history, owned by the caller; cleared on every room change
+    TurnProfiler* profiler;     // optional turn latency histograms, owned by the caller
+    FlowField flow;             // chasers' distances to the player, reset whenever the map is replaced
+    MonsterList monsters;       // listed monsters of the map, reset whenever cells are rewritten wholesale
+    SpatialGrid entities;       // 'M' monsters, treasures and amulets by position, reset likewise
+    FogOfWar fog;               // what the player has seen; off unless its radius is set
+    size_t levelBytes;          // tiles of the level template of the current room, 0 for a restored map
+    size_t peakMapBytes;        // largest live map since the session started
+    size_t peakBytes;           // largest total footprint since the session started
+
+    GameSession();
+    ~GameSession();
+    GameSession(const GameSession&) = delete;
+    GameSession& operator=(const GameSession&) = delete;
+};
+
+// function signatures
+std::string roomFileName(const std::string& dungeon, int room);
+
+const LevelTemplate* cachedLevel(const std::string& fileName, int* error = nullptr);
+
+bool parseLevel(const char* text, size_t length, LevelTemplate& level);
+
+int readLevelFile(const std::string& fileName, LevelTemplate& level);
+
+bool enterLevel(GameSession& session, const LevelTemplate& level);
+
+bool startSession(GameSession& session, const std::string& dungeon, int totalRooms);
+
+bool enterRoom(GameSession& session, int room);
+
+bool hasNextRoom(const GameSession& session);
+
+void relocateMap(GameSession& session);
+
+int stepSession(GameSession& session, char input);
+
+int idleSession(GameSession& session);
+
+bool monsterInLine(GameSession& session);
+
+void endSession(GameSession& session);
+
+size_t mapBytes(int maxRow, int maxCol);
+
+SessionFootprint sessionFootprint(const GameSession& session);
+
+void notePeakFootprint(GameSession& session);
+
+#endif
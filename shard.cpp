@@ -0,0 +1,196 @@
+#include <chrono>
+#include <pthread.h>
+#include <sched.h>
+#include "shard.h"
+
+// tasks submitted between two load comparisons
+const uint64_t REBALANCE_INTERVAL = 1024;
+// a worker counts as overloaded when it was this many times busier than the idlest one
+const uint64_t IMBALANCE_RATIO = 2;
+// and busy for at least this long since the last comparison, so idle servers never shuffle
+const uint64_t IMBALANCE_MIN_NANOS = 5000000;
+// sessions moved per rebalance
+const int MIGRATIONS_PER_REBALANCE = 4;
+
+/**
+ * CPUs this process may run on, in order, so pinning respects taskset and cgroup limits.
+ * @return  usable CPU numbers, empty if they cannot be queried.
+ */
+static std::vector<int> usableCpus() {
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0){
+        return cpus;
+    }
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu){
+        if(CPU_ISSET(cpu, &allowed)){
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+ShardPool::ShardPool(int workers, bool pinThreads)
+    : workers(), owners(), submitted(0), overloaded(-1), target(-1), migrationBudget(0), stopping(false) {
+    std::vector<int> cpus = usableCpus();
+    if(workers < 1){
+        workers = cpus.empty() ? 1 : static_cast<int>(cpus.size());
+    }
+    for(int i = 0; i < workers; ++i){
+        this->workers.emplace_back(new Worker());
+    }
+    for(int i = 0; i < workers; ++i){
+        int cpu = pinThreads && !cpus.empty() ? cpus[i % cpus.size()] : -1;
+        this->workers[i]->thread = std::thread(&ShardPool::workerLoop, this, i, cpu);
+    }
+}
+
+ShardPool::~ShardPool() {
+    stop();
+}
+
+int ShardPool::size() const {
+    return static_cast<int>(workers.size());
+}
+
+/**
+ * Queue a task on the worker owning key. New keys go to the worker with the fewest sessions.
+ * @param   key         Session key.
+ * @param   task        Work for the session.
+ */
+void ShardPool::submit(uint64_t key, std::function<void(bool migrated)> task) {
+    auto found = owners.find(key);
+    if(found == owners.end()){
+        int least = 0;
+        for(int i = 1; i < size(); ++i){
+            if(workers[i]->sessions < workers[least]->sessions){
+                least = i;
+            }
+        }
+        found = owners.emplace(key, Owner{least, false}).first;
+        workers[least]->sessions++;
+    } else if(found->second.worker == overloaded && migrationBudget > 0){
+        // the session is idle right now (the caller never submits a running session), so it can move
+        workers[overloaded]->sessions--;
+        workers[target]->sessions++;
+        found->second.worker = target;
+        found->second.migrated = true;
+        migrationBudget--;
+    }
+
+    Owner& owner = found->second;
+    bool migrated = owner.migrated;
+    owner.migrated = false;
+    Worker& worker = *workers[owner.worker];
+    {
+        std::lock_guard<std::mutex> guard(worker.lock);
+        worker.tasks.emplace_back([task = std::move(task), migrated] { task(migrated); });
+    }
+    worker.wake.notify_one();
+
+    if(++submitted % REBALANCE_INTERVAL == 0){
+        rebalance();
+    }
+}
+
+void ShardPool::forget(uint64_t key) {
+    auto found = owners.find(key);
+    if(found != owners.end()){
+        workers[found->second.worker]->sessions--;
+        owners.erase(found);
+    }
+}
+
+/**
+ * Compare how busy the workers were since the last call and, if the busiest one did
+ * IMBALANCE_RATIO times the work of the idlest, move a few of its sessions over.
+ */
+void ShardPool::rebalance() {
+    int busiest = 0;
+    int idlest = 0;
+    std::vector<uint64_t> delta(workers.size());
+    for(size_t i = 0; i < workers.size(); ++i){
+        uint64_t busy = workers[i]->busyNanos.load(std::memory_order_relaxed);
+        delta[i] = busy - workers[i]->busyAtRebalance;
+        workers[i]->busyAtRebalance = busy;
+        if(delta[i] > delta[busiest]){
+            busiest = static_cast<int>(i);
+        }
+        if(delta[i] < delta[idlest]){
+            idlest = static_cast<int>(i);
+        }
+    }
+    overloaded = -1;
+    migrationBudget = 0;
+    if(busiest != idlest && delta[busiest] >= IMBALANCE_MIN_NANOS
+       && delta[busiest] > IMBALANCE_RATIO * delta[idlest] && workers[busiest]->sessions > 1){
+        // move about half the gap, assuming the busiest worker's sessions share its load evenly,
+        // so a few hot sessions do not just bounce between two workers
+        uint64_t sessions = static_cast<uint64_t>(workers[busiest]->sessions);
+        uint64_t share = sessions * (delta[busiest] - delta[idlest]) / (2 * delta[busiest]);
+        overloaded = busiest;
+        target = idlest;
+        migrationBudget = static_cast<int>(share < 1 ? 1 : (share > MIGRATIONS_PER_REBALANCE ? MIGRATIONS_PER_REBALANCE : share));
+    }
+}
+
+void ShardPool::stop() {
+    if(stopping.exchange(true)){
+        return;
+    }
+    for(std::unique_ptr<Worker>& worker : workers){
+        {
+            std::lock_guard<std::mutex> guard(worker->lock);
+            worker->tasks.clear();
+        }
+        worker->wake.notify_all();
+    }
+    for(std::unique_ptr<Worker>& worker : workers){
+        if(worker->thread.joinable()){
+            worker->thread.join();
+        }
+    }
+}
+
+std::vector<ShardStats> ShardPool::stats() const {
+    std::vector<ShardStats> result(workers.size());
+    for(size_t i = 0; i < workers.size(); ++i){
+        result[i].sessions = workers[i]->sessions;
+        result[i].busyNanos = workers[i]->busyNanos.load(std::memory_order_relaxed);
+        result[i].tasks = workers[i]->taskCount.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+/**
+ * Run the worker's queue until stop, timing each task for the rebalancer.
+ * @param   index       Worker index.
+ * @param   cpu         CPU to pin the thread to, or -1 to leave it floating.
+ */
+void ShardPool::workerLoop(int index, int cpu) {
+    if(cpu >= 0){
+        cpu_set_t only;
+        CPU_ZERO(&only);
+        CPU_SET(cpu, &only);
+        pthread_setaffinity_np(pthread_self(), sizeof(only), &only);
+    }
+    Worker& worker = *workers[index];
+    while(true){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(worker.lock);
+            worker.wake.wait(guard, [this, &worker] { return stopping || !worker.tasks.empty(); });
+            if(stopping){
+                return;
+            }
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        auto start = std::chrono::steady_clock::now();
+        task();
+        auto spent = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        worker.busyNanos.fetch_add(static_cast<uint64_t>(spent.count()), std::memory_order_relaxed);
+        worker.taskCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
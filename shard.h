@@ -0,0 +1,75 @@
+#ifndef SHARD_H
+#define SHARD_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// a worker's share of the sessions and of the work since the last rebalance
+struct ShardStats {
+    int sessions = 0;
+    uint64_t busyNanos = 0;
+    uint64_t tasks = 0;
+};
+
+// worker threads, each pinned to one core, that own sessions by key: every task of a
+// session runs on its owner, so the session's memory is first touched by (and stays
+// local to) that core. Sessions move only when one worker has been doing much more
+// work than another, and then a few at a time.
+// submit and forget must be called from a single thread (the server's event loop).
+class ShardPool {
+public:
+    ShardPool(int workers, bool pinThreads);
+    ~ShardPool();
+    ShardPool(const ShardPool&) = delete;
+    ShardPool& operator=(const ShardPool&) = delete;
+
+    int size() const;
+
+    // run task on the key's owner; migrated is true on the first task after the key moved
+    void submit(uint64_t key, std::function<void(bool migrated)> task);
+
+    // the key's session is gone
+    void forget(uint64_t key);
+
+    void stop();
+
+    std::vector<ShardStats> stats() const;
+
+private:
+    struct Worker {
+        std::thread thread{};
+        std::mutex lock{};
+        std::condition_variable wake{};
+        std::deque<std::function<void()>> tasks{};
+        std::atomic<uint64_t> busyNanos{0};
+        std::atomic<uint64_t> taskCount{0};
+        int sessions = 0;               // owned keys, event loop only
+        uint64_t busyAtRebalance = 0;   // event loop only
+    };
+
+    // owner of a key and whether its next task is its first one on a new worker
+    struct Owner {
+        int worker = 0;
+        bool migrated = false;
+    };
+
+    void workerLoop(int index, int cpu);
+    void rebalance();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::unordered_map<uint64_t, Owner> owners;
+    uint64_t submitted;
+    int overloaded;             // worker sessions are currently moved away from, or -1
+    int target;                 // worker they are moved to
+    int migrationBudget;        // sessions still to move in this rebalance
+    std::atomic<bool> stopping;
+};
+
+#endif
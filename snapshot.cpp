@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "journal.h"
+#include "snapshot.h"
+
+using std::string;
+
+// snapshot layout, all integers int32 in native byte order:
+//   magic, version, dungeon name length, total_rooms, current_room, maxRow, maxCol,
+//   player row, player col, player treasure, total_moves, status,
+//   dungeon name bytes, maxRow * maxCol tile bytes (row-major),
+//   one heading byte (0 up to 3 left) per hugger tile, in the same order; version 1 has none
+const int32_t SNAPSHOT_MAGIC   = 0x56534344;    // "DCSV"
+const int32_t SNAPSHOT_VERSION = 2;
+const int SNAPSHOT_FIELDS = 12;
+const size_t SNAPSHOT_HEADER = SNAPSHOT_FIELDS * sizeof(int32_t);
+
+/**
+ * @param   tile    Tile byte read from a snapshot.
+ * @return  true if a saved map may hold the tile anywhere but the player's cell.
+ */
+static bool savedTile(char tile) {
+    return tile == TILE_OPEN || tile == TILE_TREASURE || tile == TILE_AMULET || tile == TILE_PILLAR
+           || tile == TILE_DOOR || tile == TILE_EXIT || isMonsterTile(tile);
+}
+
+/**
+ * @param   session     Session to save.
+ * @return  the save file of the session's dungeon, e.g. "easy.sav".
+ */
+string saveFileName(const GameSession& session) {
+    return session.dungeon + ".sav";
+}
+
+/**
+ * @param   session     Session to save.
+ * @return  number of bytes writeSnapshot produces for the session.
+ */
+size_t snapshotSize(const GameSession& session) {
+    size_t huggers = 0;
+    for(int row = 0; row < session.maxRow; ++row){
+        huggers += static_cast<size_t>(std::count(session.map[row], session.map[row] + session.maxCol, TILE_HUGGER));
+    }
+    return SNAPSHOT_HEADER + session.dungeon.size() + static_cast<size_t>(session.maxRow) * session.maxCol + huggers;
+}
+
+/**
+ * Serialize the full session into out, replacing its contents. Reusing the same buffer
+ * every turn means checkpointing allocates only when the map grows.
+ * @param   session     Session to save.
+ * @param   out         Snapshot bytes.
+ * @updates out
+ */
+void writeSnapshot(const GameSession& session, std::vector<char>& out) {
+    static thread_local std::vector<MonsterHeading> headings;
+    collectHeadings(session.monsters, session.map, session.maxRow, session.maxCol, headings);
+    out.resize(snapshotSize(session));
+    int32_t header[SNAPSHOT_FIELDS] = {
+        SNAPSHOT_MAGIC, SNAPSHOT_VERSION, static_cast<int32_t>(session.dungeon.size()),
+        session.total_rooms, session.current_room, session.maxRow, session.maxCol,
+        session.player.row, session.player.col, session.player.treasure,
+        session.total_moves, session.status
+    };
+    char* cursor = out.data();
+    std::memcpy(cursor, header, SNAPSHOT_HEADER);
+    cursor += SNAPSHOT_HEADER;
+    std::memcpy(cursor, session.dungeon.data(), session.dungeon.size());
+    cursor += session.dungeon.size();
+    for(int row = 0; row < session.maxRow; ++row){
+        std::memcpy(cursor, session.map[row], session.maxCol);
+        cursor += session.maxCol;
+    }
+    for(int row = 0; row < session.maxRow; ++row){
+        for(int col = 0; col < session.maxCol; ++col){
+            if(session.map[row][col] == TILE_HUGGER){
+                *cursor++ = static_cast<char>(headingAt(headings, row, col));
+            }
+        }
+    }
+}
+
+/**
+ * Restore a session from a snapshot without touching the level files. A snapshot is
+ * rejected unless it describes a session the game could have reached: known tiles only,
+ * exactly one player tile at the saved player position, a room within the dungeon,
+ * no negative treasure or move counts and a valid heading for every hugger. Snapshots of
+ * version 1 carry no headings; their huggers start facing up.
+ * @param   data        Snapshot bytes.
+ * @param   length      Number of snapshot bytes.
+ * @param   session     Session to overwrite; left unchanged if the snapshot is invalid.
+ * @return  true if the snapshot was valid and restored.
+ * @updates session
+ */
+bool readSnapshot(const char* data, size_t length, GameSession& session) {
+    if(length < SNAPSHOT_HEADER){
+        return false;
+    }
+    int32_t header[SNAPSHOT_FIELDS];
+    std::memcpy(header, data, SNAPSHOT_HEADER);
+    int32_t nameLength = header[2];
+    int32_t maxRow = header[5];
+    int32_t maxCol = header[6];
+    if(header[0] != SNAPSHOT_MAGIC || (header[1] != SNAPSHOT_VERSION && header[1] != 1) || nameLength < 0
+       || maxRow <= 0 || maxCol <= 0 || maxRow > (INT32_MAX / maxCol)){
+        return false;
+    }
+    size_t tilesEnd = SNAPSHOT_HEADER + static_cast<size_t>(nameLength) + static_cast<size_t>(maxRow) * maxCol;
+    if(length < tilesEnd){
+        return false;
+    }
+    int32_t totalRooms = header[3];
+    int32_t currentRoom = header[4];
+    int32_t playerRow = header[7];
+    int32_t playerCol = header[8];
+    if(playerRow < 0 || playerCol < 0 || playerRow >= maxRow || playerCol >= maxCol){
+        return false;
+    }
+    if(currentRoom < 1 || currentRoom > totalRooms || header[9] < 0 || header[10] < 0
+       || header[11] < STATUS_STAY || header[11] > STATUS_ESCAPE){
+        return false;
+    }
+    const char* tiles = data + SNAPSHOT_HEADER + nameLength;
+    size_t huggers = 0;
+    for(int32_t row = 0; row < maxRow; ++row){
+        const char* cells = tiles + static_cast<size_t>(row) * maxCol;
+        for(int32_t col = 0; col < maxCol; ++col){
+            bool playerCell = row == playerRow && col == playerCol;
+            if(playerCell ? cells[col] != TILE_PLAYER : !savedTile(cells[col])){
+                return false;
+            }
+            huggers += cells[col] == TILE_HUGGER ? 1 : 0;
+        }
+    }
+    const char* saved = data + tilesEnd;
+    if(length != tilesEnd + (header[1] == 1 ? 0 : huggers)){
+        return false;
+    }
+    for(const char* heading = saved; heading != data + length; ++heading){
+        if(static_cast<unsigned char>(*heading) > 3){
+            return false;
+        }
+    }
+
+    char** map = createMap(maxRow, maxCol);
+    const char* cursor = data + SNAPSHOT_HEADER;
+    string dungeon(cursor, static_cast<size_t>(nameLength));
+    cursor += nameLength;
+    for(int row = 0; row < maxRow; ++row){
+        std::memcpy(map[row], cursor, maxCol);
+        cursor += maxCol;
+    }
+
+    endSession(session);
+    if(session.journal != nullptr){
+        clearJournal(*session.journal);
+    }
+    session.dungeon = dungeon;
+    session.total_rooms = totalRooms;
+    session.current_room = currentRoom;
+    session.map = map;
+    session.maxRow = maxRow;
+    session.maxCol = maxCol;
+    session.player.row = playerRow;
+    session.player.col = playerCol;
+    session.player.treasure = header[9];
+    session.total_moves = header[10];
+    session.status = header[11];
+    session.loadError = LEVEL_OK;
+    session.peakMapBytes = 0;
+    session.peakBytes = 0;
+
+    // the headings follow the hugger tiles in row-major order
+    std::vector<MonsterHeading> headings;
+    for(int row = 0; row < maxRow && saved != data + length; ++row){
+        for(int col = 0; col < maxCol; ++col){
+            if(map[row][col] != TILE_HUGGER){
+                continue;
+            }
+            uint8_t heading = static_cast<uint8_t>(*saved++);
+            if(heading != 0){
+                headings.push_back(MonsterHeading{row, col, heading});
+            }
+        }
+    }
+    restoreHeadings(session.monsters, map, maxRow, maxCol, headings);
+    notePeakFootprint(session);
+    return true;
+}
+
+/**
+ * Save the session to a file with a single write. The snapshot goes to a uniquely named
+ * temporary file that is renamed over the target, so a crash never leaves a half-written
+ * save behind and two saves of the same dungeon never write into each other's file.
+ * @param   session     Session to save.
+ * @param   fileName    Save file.
+ * @param   buffer      Scratch buffer for the snapshot, reused between saves.
+ * @return  true if the file was written.
+ * @updates buffer
+ */
+bool saveSession(const GameSession& session, const string& fileName, std::vector<char>& buffer) {
+    if(session.map == nullptr){
+        return false;
+    }
+    writeSnapshot(session, buffer);
+    string temporary = fileName + ".XXXXXX";
+    int fd = mkostemp(temporary.data(), O_CLOEXEC);
+    if(fd < 0){
+        return false;
+    }
+    ssize_t written = write(fd, buffer.data(), buffer.size());
+    bool ok = written == static_cast<ssize_t>(buffer.size());
+    ok = close(fd) == 0 && ok;
+    if(!ok || std::rename(temporary.c_str(), fileName.c_str()) != 0){
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Load a session saved with saveSession.
+ * @param   fileName    Save file.
+ * @param   session     Session to overwrite.
+ * @return  true if the save file was read and valid.
+ * @updates session
+ */
+bool loadSession(const string& fileName, GameSession& session) {
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size < 0){
+        close(fd);
+        return false;
+    }
+    std::vector<char> data(static_cast<size_t>(info.st_size));
+    size_t got = 0;
+    while(got < data.size()){
+        ssize_t chunk = read(fd, data.data() + got, data.size() - got);
+        if(chunk <= 0){
+            break;
+        }
+        got += static_cast<size_t>(chunk);
+    }
+    close(fd);
+    return got == data.size() && readSnapshot(data.data(), data.size(), session);
+}
@@ -0,0 +1,24 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "session.h"
+
+// command that saves the game to <dungeon>.sav
+const char INPUT_SAVE = 'p';
+
+// function signatures
+std::string saveFileName(const GameSession& session);
+
+size_t snapshotSize(const GameSession& session);
+
+void writeSnapshot(const GameSession& session, std::vector<char>& out);
+
+bool readSnapshot(const char* data, size_t length, GameSession& session);
+
+bool saveSession(const GameSession& session, const std::string& fileName, std::vector<char>& buffer);
+
+bool loadSession(const std::string& fileName, GameSession& session);
+
+#endif
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include "spatial.h"
+
+/**
+ * @param   tile    Map tile.
+ * @return  true if the grid keeps track of tiles of this kind.
+ */
+bool isIndexedTile(char tile) {
+    return tile == TILE_MONSTER || tile == TILE_TREASURE || tile == TILE_AMULET;
+}
+
+/**
+ * Forget the grid, so the next sync rebuilds it. Called whenever map cells are
+ * rewritten wholesale: a new room or a loaded save.
+ * @param   grid        Grid to clear.
+ * @updates grid
+ */
+void resetSpatialGrid(SpatialGrid& grid) {
+    grid.buckets.clear();
+    grid.found.clear();
+    grid.map = nullptr;
+    grid.maxRow = 0;
+    grid.maxCol = 0;
+    grid.bucketRows = 0;
+    grid.bucketCols = 0;
+    grid.entryBytes = 0;
+}
+
+/**
+ * @return  bucket holding the cell.
+ */
+static std::vector<SpatialEntry>& bucketOf(SpatialGrid& grid, int row, int col) {
+    return grid.buckets[static_cast<size_t>(row / SPATIAL_BUCKET) * grid.bucketCols + col / SPATIAL_BUCKET];
+}
+
+/**
+ * Rebuild the grid from the indexed tiles of a map.
+ * @param   grid        Grid to fill.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @updates grid
+ */
+void buildSpatialGrid(SpatialGrid& grid, char** map, int maxRow, int maxCol) {
+    resetSpatialGrid(grid);
+    grid.map = map;
+    grid.maxRow = maxRow;
+    grid.maxCol = maxCol;
+    grid.bucketRows = (maxRow + SPATIAL_BUCKET - 1) / SPATIAL_BUCKET;
+    grid.bucketCols = (maxCol + SPATIAL_BUCKET - 1) / SPATIAL_BUCKET;
+    grid.buckets.resize(static_cast<size_t>(grid.bucketRows) * grid.bucketCols);
+    for(int row = 0; row < maxRow; ++row){
+        for(int col = 0; col < maxCol; ++col){
+            if(isIndexedTile(map[row][col])){
+                addEntity(grid, row, col);
+            }
+        }
+    }
+}
+
+/**
+ * Rebuild the grid if it was reset or belongs to another map, e.g. one replaced by an amulet.
+ * @param   grid        Grid of the map.
+ * @param   map         Dungeon map.
+ * @param   maxRow      Number of rows in the dungeon table (aka height).
+ * @param   maxCol      Number of columns in the dungeon table (aka width).
+ * @updates grid
+ */
+void syncSpatialGrid(SpatialGrid& grid, char** map, int maxRow, int maxCol) {
+    if(grid.map != map || grid.maxRow != maxRow || grid.maxCol != maxCol){
+        buildSpatialGrid(grid, map, maxRow, maxCol);
+    }
+}
+
+/**
+ * Index a cell that now holds an indexed tile.
+ * @param   grid        Grid of the map.
+ * @param   row         Cell row.
+ * @param   col         Cell column.
+ * @updates grid
+ */
+void addEntity(SpatialGrid& grid, int row, int col) {
+    SpatialEntry entry;
+    entry.row = row;
+    entry.col = col;
+    std::vector<SpatialEntry>& bucket = bucketOf(grid, row, col);
+    size_t capacity = bucket.capacity();
+    bucket.push_back(entry);
+    grid.entryBytes += (bucket.capacity() - capacity) * sizeof(SpatialEntry);
+}
+
+/**
+ * Drop a cell from the index, if it is there.
+ * @param   grid        Grid of the map.
+ * @param   row         Cell row.
+ * @param   col         Cell column.
+ * @updates grid
+ */
+void removeEntity(SpatialGrid& grid, int row, int col) {
+    std::vector<SpatialEntry>& bucket = bucketOf(grid, row, col);
+    for(size_t i = 0; i < bucket.size(); ++i){
+        if(bucket[i].row == row && bucket[i].col == col){
+            bucket[i] = bucket.back();
+            bucket.pop_back();
+            return;
+        }
+    }
+}
+
+/**
+ * Collect the entries of the buckets in a rectangle of buckets that lie inside a rectangle
+ * of cells and show the wanted tile. Entries whose tile is no longer indexed are dropped.
+ * @param   grid        Grid of the map.
+ * @param   rowFirst    First row of the cell rectangle, inside the map.
+ * @param   rowLast     Last row of the cell rectangle, inside the map.
+ * @param   colFirst    First column of the cell rectangle, inside the map.
+ * @param   colLast     Last column of the cell rectangle, inside the map.
+ * @param   tile        Tile to look for, or 0 for every indexed tile.
+ * @updates grid
+ */
+static void collect(SpatialGrid& grid, int rowFirst, int rowLast, int colFirst, int colLast, char tile) {
+    grid.found.clear();
+    for(int bucketRow = rowFirst / SPATIAL_BUCKET; bucketRow <= rowLast / SPATIAL_BUCKET; ++bucketRow){
+        for(int bucketCol = colFirst / SPATIAL_BUCKET; bucketCol <= colLast / SPATIAL_BUCKET; ++bucketCol){
+            std::vector<SpatialEntry>& bucket = grid.buckets[static_cast<size_t>(bucketRow) * grid.bucketCols + bucketCol];
+            for(size_t i = 0; i < bucket.size();){
+                SpatialEntry entry = bucket[i];
+                char here = grid.map[entry.row][entry.col];
+                if(!isIndexedTile(here)){
+                    bucket[i] = bucket.back();
+                    bucket.pop_back();
+                    continue;
+                }
+                ++i;
+                if(entry.row >= rowFirst && entry.row <= rowLast && entry.col >= colFirst && entry.col <= colLast
+                   && (tile == 0 || here == tile)){
+                    grid.found.push_back(entry);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Find the indexed tiles within a radius of a cell. Touches only the buckets the circle overlaps.
+ * @param   grid        Synced grid of the map.
+ * @param   row         Row of the center.
+ * @param   col         Column of the center.
+ * @param   radius      Largest straight-line distance, in cells.
+ * @param   tile        Tile to look for, or 0 for every indexed tile.
+ * @return  the matching cells, valid until the next query.
+ * @updates grid
+ */
+const std::vector<SpatialEntry>& entitiesInRadius(SpatialGrid& grid, int row, int col, int radius, char tile) {
+    grid.found.clear();
+    if(grid.maxRow == 0 || radius < 0){
+        return grid.found;
+    }
+    collect(grid, std::max(row - radius, 0), std::min(row + radius, grid.maxRow - 1),
+            std::max(col - radius, 0), std::min(col + radius, grid.maxCol - 1), tile);
+    long long reach = static_cast<long long>(radius) * radius;
+    size_t kept = 0;
+    for(const SpatialEntry& entry : grid.found){
+        long long rows = entry.row - row;
+        long long cols = entry.col - col;
+        if(rows * rows + cols * cols <= reach){
+            grid.found[kept++] = entry;
+        }
+    }
+    grid.found.resize(kept);
+    return grid.found;
+}
+
+/**
+ * Find the indexed tiles on a row between two columns, both included.
+ * @param   grid        Synced grid of the map.
+ * @param   row         Row to search.
+ * @param   colFirst    First column.
+ * @param   colLast     Last column.
+ * @param   tile        Tile to look for, or 0 for every indexed tile.
+ * @return  the matching cells, valid until the next query.
+ * @updates grid
+ */
+const std::vector<SpatialEntry>& entitiesOnRow(SpatialGrid& grid, int row, int colFirst, int colLast, char tile) {
+    grid.found.clear();
+    colFirst = std::max(colFirst, 0);
+    colLast = std::min(colLast, grid.maxCol - 1);
+    if(row < 0 || row >= grid.maxRow || colFirst > colLast){
+        return grid.found;
+    }
+    collect(grid, row, row, colFirst, colLast, tile);
+    return grid.found;
+}
+
+/**
+ * Find the indexed tiles on a column between two rows, both included.
+ * @param   grid        Synced grid of the map.
+ * @param   col         Column to search.
+ * @param   rowFirst    First row.
+ * @param   rowLast     Last row.
+ * @param   tile        Tile to look for, or 0 for every indexed tile.
+ * @return  the matching cells, valid until the next query.
+ * @updates grid
+ */
+const std::vector<SpatialEntry>& entitiesOnColumn(SpatialGrid& grid, int col, int rowFirst, int rowLast, char tile) {
+    grid.found.clear();
+    rowFirst = std::max(rowFirst, 0);
+    rowLast = std::min(rowLast, grid.maxRow - 1);
+    if(col < 0 || col >= grid.maxCol || rowFirst > rowLast){
+        return grid.found;
+    }
+    collect(grid, rowFirst, rowLast, col, col, tile);
+    return grid.found;
+}
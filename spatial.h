@@ -0,0 +1,49 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "logic.h"
+
+// width and height of one bucket, in cells
+const int SPATIAL_BUCKET = 16;
+
+// position of an indexed tile
+struct SpatialEntry {
+    int32_t row = 0;
+    int32_t col = 0;
+};
+
+// uniform bucket grid over the sparse tiles of a map: 'M' monsters, treasures and amulets.
+// Entries whose tile was picked up or flattened are dropped lazily by the next query that meets them.
+struct SpatialGrid {
+    std::vector<std::vector<SpatialEntry>> buckets{};   // row-major, bucketRows x bucketCols
+    std::vector<SpatialEntry> found{};                  // result of the last query
+    char** map = nullptr;                               // map the grid was built from
+    int maxRow = 0;
+    int maxCol = 0;
+    int bucketRows = 0;
+    int bucketCols = 0;
+    size_t entryBytes = 0;                              // capacity of every bucket, kept up to date by addEntity
+};
+
+// function signatures
+bool isIndexedTile(char tile);
+
+void resetSpatialGrid(SpatialGrid& grid);
+
+void buildSpatialGrid(SpatialGrid& grid, char** map, int maxRow, int maxCol);
+
+void syncSpatialGrid(SpatialGrid& grid, char** map, int maxRow, int maxCol);
+
+void addEntity(SpatialGrid& grid, int row, int col);
+
+void removeEntity(SpatialGrid& grid, int row, int col);
+
+const std::vector<SpatialEntry>& entitiesInRadius(SpatialGrid& grid, int row, int col, int radius, char tile);
+
+const std::vector<SpatialEntry>& entitiesOnRow(SpatialGrid& grid, int row, int colFirst, int colLast, char tile);
+
+const std::vector<SpatialEntry>& entitiesOnColumn(SpatialGrid& grid, int col, int rowFirst, int rowLast, char tile);
+
+#endif
@@ -0,0 +1,94 @@
+#include "threadpool.h"
+
+WorkerPool::WorkerPool(int threads)
+    : workers(), lock(), wake(), done(), current(nullptr), count(0), generation(0), pending(0), stopping(false) {
+    if(threads < 1){
+        threads = 1;
+    }
+    // slot 0 is the calling thread
+    for(int slot = 1; slot < threads; ++slot){
+        workers.emplace_back(&WorkerPool::workerLoop, this, slot);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+}
+
+int WorkerPool::size() const {
+    return static_cast<int>(workers.size()) + 1;
+}
+
+/**
+ * Slice [0, count) of thread slot into a contiguous range.
+ * @param   count       Number of indices.
+ * @param   slots       Number of threads sharing them.
+ * @param   slot        Thread whose slice is wanted.
+ * @param   begin       First index of the slice.
+ * @param   end         One past the last index of the slice.
+ * @updates begin, end
+ */
+static void sliceRange(int count, int slots, int slot, int& begin, int& end) {
+    begin = static_cast<int>(static_cast<long long>(count) * slot / slots);
+    end = static_cast<int>(static_cast<long long>(count) * (slot + 1) / slots);
+}
+
+void WorkerPool::parallelFor(int count, const std::function<void(int, int)>& job) {
+    int slots = size();
+    if(slots == 1 || count < slots){
+        job(0, count);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current = &job;
+        this->count = count;
+        pending = slots - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    int begin = 0;
+    int end = 0;
+    sliceRange(count, slots, 0, begin, end);
+    job(begin, end);
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return pending == 0; });
+    current = nullptr;
+}
+
+void WorkerPool::workerLoop(int slot) {
+    int seen = 0;
+    while(true){
+        const std::function<void(int, int)>* job = nullptr;
+        int jobCount = 0;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+            if(stopping){
+                return;
+            }
+            seen = generation;
+            job = current;
+            jobCount = count;
+        }
+
+        int begin = 0;
+        int end = 0;
+        sliceRange(jobCount, size(), slot, begin, end);
+        (*job)(begin, end);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if(--pending == 0){
+            done.notify_one();
+        }
+    }
+}
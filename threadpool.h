@@ -0,0 +1,37 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads that split a range of indices between them;
+// the calling thread takes the first slice, so a pool of 1 runs everything inline
+class WorkerPool {
+public:
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int size() const;
+
+    // run job(begin, end) over [0, count) in contiguous slices, one per thread, and wait for all of them
+    void parallelFor(int count, const std::function<void(int, int)>& job);
+
+private:
+    void workerLoop(int slot);
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int, int)>* current;
+    int count;
+    int generation;
+    int pending;
+    bool stopping;
+};
+
+#endif
@@ -0,0 +1,537 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "env.h"
+#include "helper.h"
+#include "levelgen.h"
+#include "logic.h"
+#include "session.h"
+
+using std::string;
+using std::vector;
+
+// Microbenchmarks of the logic.cpp entry points, the turn path and the training environment, with JSON output for tracking.
+// Build from the repository root:
+//   g++ -std=c++20 -O2 -pthread -I. -o dungeon_bench tools/bench.cpp tools/levelgen.cpp $(ls *.cpp | grep -v dungeoncrawler.cpp)
+// Run from the repository root, so the shipped levels are found:
+//   ./dungeon_bench [--json <file>] [--reps <count>] [--min-time <ms>] [--filter <text>]
+
+// shipped levels, benchmarked when present in the working directory
+static const char* SHIPPED_LEVELS[] = {
+    "tutorial1.txt", "tutorial2.txt", "tutorial3.txt", "tutorial4.txt",
+    "easy1.txt", "easy2.txt", "hard1.txt", "hard2.txt", "hard3.txt"
+};
+
+// shipped dungeons and their number of rooms, played through stepSession
+static const std::pair<const char*, int> SHIPPED_DUNGEONS[] = {{"tutorial", 4}, {"easy", 2}, {"hard", 3}};
+
+// side lengths of the generated square levels
+static const int GENERATED_SIZES[] = {64, 256, 1024};
+
+// maps copied ahead of a timed batch for benchmarks that consume their input
+static const int BATCH = 16;
+
+// one benchmark: runs the operation n times and returns the nanoseconds spent in the timed part
+struct Benchmark {
+    string name{};
+    std::function<double(uint64_t)> run;
+};
+
+// per-repetition results of one benchmark
+struct BenchResult {
+    string name{};
+    uint64_t iterations = 0;
+    vector<double> nsPerOp{};
+    double median = 0.0;
+    double mad = 0.0;
+};
+
+// discards everything written to it, so outputMap can run without a terminal
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        return count;
+    }
+};
+
+// keeps results alive so the compiler cannot drop the benchmarked calls
+static volatile uint64_t sink = 0;
+
+/**
+ * @return  nanoseconds on a monotonic clock.
+ */
+static uint64_t nowNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * splitmix64 step for the random walks.
+ * @param   state       Generator state.
+ * @return  next random value.
+ * @updates state
+ */
+static uint64_t nextRandom(uint64_t& state) {
+    state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @param   values      Samples; reordered.
+ * @return  median of the samples.
+ */
+static double median(vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+/**
+ * Copy a map into a fresh allocation.
+ * @param   map         Map to copy.
+ * @param   maxRow      Number of rows.
+ * @param   maxCol      Number of columns.
+ * @return  the copy.
+ */
+static char** copyMap(char** map, int maxRow, int maxCol) {
+    char** copy = createMap(maxRow, maxCol);
+    for(int row = 0; row < maxRow; ++row){
+        std::memcpy(copy[row], map[row], maxCol);
+    }
+    return copy;
+}
+
+/**
+ * A level loaded once, shared by the benchmarks that need one.
+ */
+struct LoadedLevel {
+    string name{};
+    char** map = nullptr;
+    int maxRow = 0;
+    int maxCol = 0;
+    Player player{};
+
+    LoadedLevel() = default;
+    ~LoadedLevel() {
+        deleteMap(map, maxRow);
+    }
+    LoadedLevel(const LoadedLevel&) = delete;
+    LoadedLevel& operator=(const LoadedLevel&) = delete;
+};
+
+/**
+ * Time loadLevel on a level file.
+ */
+static Benchmark loadBenchmark(const string& name, const string& fileName) {
+    return {"loadLevel/" + name, [fileName](uint64_t count){
+        double spent = 0.0;
+        for(uint64_t i = 0; i < count; ++i){
+            int maxRow = 0;
+            int maxCol = 0;
+            Player player;
+            uint64_t start = nowNanos();
+            char** map = loadLevel(fileName, maxRow, maxCol, player);
+            spent += static_cast<double>(nowNanos() - start);
+            sink = sink + static_cast<uint64_t>(maxRow);
+            deleteMap(map, maxRow);
+        }
+        return spent;
+    }};
+}
+
+/**
+ * Time a createMap and deleteMap pair.
+ */
+static Benchmark createBenchmark(int size) {
+    return {"createMap+deleteMap/" + std::to_string(size), [size](uint64_t count){
+        uint64_t start = nowNanos();
+        for(uint64_t i = 0; i < count; ++i){
+            int rows = size;
+            char** map = createMap(rows, size);
+            sink = sink + static_cast<uint64_t>(map[rows - 1][size - 1]);
+            deleteMap(map, rows);
+        }
+        return static_cast<double>(nowNanos() - start);
+    }};
+}
+
+/**
+ * Time resizeMap on copies of a level, doubling each copy `times` times in a row.
+ * Copies are made and the results freed outside the timed part.
+ */
+static Benchmark resizeBenchmark(const string& name, const LoadedLevel& level, int times) {
+    return {name, [&level, times](uint64_t count){
+        double spent = 0.0;
+        char** maps[BATCH];
+        for(uint64_t done = 0; done < count; done += BATCH){
+            int batch = static_cast<int>(std::min<uint64_t>(BATCH, count - done));
+            for(int i = 0; i < batch; ++i){
+                maps[i] = copyMap(level.map, level.maxRow, level.maxCol);
+            }
+            int rows = level.maxRow;
+            int cols = level.maxCol;
+            uint64_t start = nowNanos();
+            for(int i = 0; i < batch; ++i){
+                rows = level.maxRow;
+                cols = level.maxCol;
+                for(int time = 0; time < times; ++time){
+                    maps[i] = resizeMap(maps[i], rows, cols);
+                }
+            }
+            spent += static_cast<double>(nowNanos() - start);
+            for(int i = 0; i < batch; ++i){
+                int freed = rows;
+                deleteMap(maps[i], freed);
+            }
+        }
+        return spent;
+    }};
+}
+
+/**
+ * Time getDirection and doPlayerMove on a random walk over a copy of a level.
+ */
+static Benchmark walkBenchmark(const LoadedLevel& level) {
+    return {"getDirection+doPlayerMove/" + level.name, [&level](uint64_t count){
+        static const char MOVES[4] = {MOVE_UP, MOVE_LEFT, MOVE_DOWN, MOVE_RIGHT};
+        char** map = copyMap(level.map, level.maxRow, level.maxCol);
+        Player player = level.player;
+        uint64_t state = 42;
+        uint64_t start = nowNanos();
+        for(uint64_t i = 0; i < count; ++i){
+            int nextRow = player.row;
+            int nextCol = player.col;
+            getDirection(MOVES[nextRandom(state) & 3], nextRow, nextCol);
+            sink = sink + static_cast<uint64_t>(doPlayerMove(map, level.maxRow, level.maxCol, player, nextRow, nextCol));
+        }
+        double spent = static_cast<double>(nowNanos() - start);
+        int rows = level.maxRow;
+        deleteMap(map, rows);
+        return spent;
+    }};
+}
+
+/**
+ * Time doMonsterAttack with the player in the middle of a map. The player's row and column,
+ * the only cells it changes, are restored from the level outside the timed part.
+ */
+static Benchmark attackBenchmark(const string& name, const LoadedLevel& level) {
+    return {name, [&level](uint64_t count){
+        char** map = copyMap(level.map, level.maxRow, level.maxCol);
+        const Player& player = level.player;
+        double spent = 0.0;
+        for(uint64_t i = 0; i < count; ++i){
+            uint64_t start = nowNanos();
+            sink = sink + (doMonsterAttack(map, level.maxRow, level.maxCol, player) ? 1 : 0);
+            spent += static_cast<double>(nowNanos() - start);
+            std::memcpy(map[player.row], level.map[player.row], level.maxCol);
+            for(int row = 0; row < level.maxRow; ++row){
+                map[row][player.col] = level.map[row][player.col];
+            }
+        }
+        int rows = level.maxRow;
+        deleteMap(map, rows);
+        return spent;
+    }};
+}
+
+/**
+ * Time outputMap with cout sent to a sink that drops the text.
+ */
+static Benchmark outputBenchmark(const LoadedLevel& level) {
+    return {"outputMap/" + level.name, [&level](uint64_t count){
+        NullBuffer discard;
+        std::streambuf* console = std::cout.rdbuf(&discard);
+        uint64_t start = nowNanos();
+        for(uint64_t i = 0; i < count; ++i){
+            outputMap(level.map, level.maxRow, level.maxCol);
+        }
+        double spent = static_cast<double>(nowNanos() - start);
+        std::cout.rdbuf(console);
+        return spent;
+    }};
+}
+
+/**
+ * Time whole turns through stepSession: player move, monsters, amulets and room changes,
+ * on a random walk that restarts the dungeon whenever it ends.
+ */
+static Benchmark stepBenchmark(const string& dungeon, int rooms) {
+    return {"stepSession/" + dungeon, [dungeon, rooms](uint64_t count){
+        static const char MOVES[5] = {MOVE_UP, MOVE_LEFT, MOVE_DOWN, MOVE_RIGHT, INPUT_STAY};
+        GameSession session;
+        startSession(session, dungeon, rooms);
+        uint64_t state = 7;
+        uint64_t start = nowNanos();
+        for(uint64_t i = 0; i < count; ++i){
+            int turn = stepSession(session, MOVES[nextRandom(state) % 5]);
+            if(turn == TURN_LEAVE && hasNextRoom(session)){
+                enterRoom(session, session.current_room + 1);
+            } else if(turn != TURN_CONTINUE){
+                startSession(session, dungeon, rooms);
+            }
+        }
+        return static_cast<double>(nowNanos() - start);
+    }};
+}
+
+/**
+ * Time VecEnv::step over the shipped dungeons, counting one operation per environment stepped,
+ * so the inverse of the result is environment steps per second. Actions are drawn outside the
+ * timed part; each batch step includes the observation encoding and any episode resets.
+ */
+static Benchmark envBenchmark(int envs, int threads, int format, const char* formatName) {
+    string name = "VecEnv.step/" + std::to_string(envs) + "x" + std::to_string(threads) + "t/" + formatName;
+    return {name, [envs, threads, format](uint64_t count){
+        EnvConfig config;
+        for(const auto& dungeon : SHIPPED_DUNGEONS){
+            config.dungeons.push_back({dungeon.first, dungeon.second});
+        }
+        config.numEnvs = envs;
+        config.numThreads = threads;
+        config.format = format;
+        VecEnv env(config);
+        env.reset(1);
+        vector<uint8_t> actions(static_cast<size_t>(envs));
+        uint64_t state = 11;
+        uint64_t steps = std::max<uint64_t>(1, count / static_cast<uint64_t>(envs));
+        double spent = 0.0;
+        for(uint64_t i = 0; i < steps; ++i){
+            for(uint8_t& action : actions){
+                action = static_cast<uint8_t>(nextRandom(state) % ACTION_COUNT);
+            }
+            uint64_t start = nowNanos();
+            env.step(actions.data());
+            spent += static_cast<double>(nowNanos() - start);
+            sink = sink + env.dones()[0];
+        }
+        return spent / static_cast<double>(steps * static_cast<uint64_t>(envs)) * static_cast<double>(count);
+    }};
+}
+
+/**
+ * Load a level file into a LoadedLevel, quietly skipping files that are missing.
+ */
+static bool loadInto(LoadedLevel& level, const string& name, const string& fileName) {
+    level.name = name;
+    level.map = loadLevel(fileName, level.maxRow, level.maxCol, level.player);
+    return level.map != nullptr;
+}
+
+/**
+ * Build a square open map with the player in the middle and, if wanted, a monster at the
+ * far end of each of the four rays, so doMonsterAttack scans rays of exactly `length` cells.
+ */
+static void rayLevel(LoadedLevel& level, int length) {
+    int size = 2 * length + 1;
+    level.name = "ray" + std::to_string(length);
+    level.maxRow = size;
+    level.maxCol = size;
+    level.map = createMap(size, size);
+    level.player.row = length;
+    level.player.col = length;
+    level.map[length][length] = TILE_PLAYER;
+    level.map[0][length] = TILE_MONSTER;
+    level.map[size - 1][length] = TILE_MONSTER;
+    level.map[length][0] = TILE_MONSTER;
+    level.map[length][size - 1] = TILE_MONSTER;
+}
+
+/**
+ * Run one benchmark: grow the iteration count until one repetition takes minNanos, then
+ * time `reps` repetitions of that many iterations.
+ */
+static BenchResult measure(const Benchmark& benchmark, int reps, double minNanos) {
+    BenchResult result;
+    result.name = benchmark.name;
+    uint64_t count = 1;
+    while(true){
+        double spent = benchmark.run(count);
+        if(spent >= minNanos || count >= (1ULL << 32)){
+            break;
+        }
+        double scale = spent > 0.0 ? minNanos / spent * 1.2 : 10.0;
+        count = static_cast<uint64_t>(static_cast<double>(count) * std::clamp(scale, 2.0, 100.0));
+    }
+    result.iterations = count;
+    for(int rep = 0; rep < reps; ++rep){
+        result.nsPerOp.push_back(benchmark.run(count) / static_cast<double>(count));
+    }
+    result.median = median(result.nsPerOp);
+    vector<double> deviations;
+    for(double value : result.nsPerOp){
+        deviations.push_back(value > result.median ? value - result.median : result.median - value);
+    }
+    result.mad = median(deviations);
+    return result;
+}
+
+/**
+ * Write the results as JSON: one object per benchmark with every repetition.
+ */
+static bool writeJson(const string& fileName, const vector<BenchResult>& results, int reps) {
+    FILE* file = std::fopen(fileName.c_str(), "w");
+    if(file == nullptr){
+        return false;
+    }
+    std::fprintf(file, "{\n  \"unit\": \"ns_per_op\",\n  \"reps\": %d,\n  \"benchmarks\": [\n", reps);
+    for(size_t i = 0; i < results.size(); ++i){
+        const BenchResult& result = results[i];
+        std::fprintf(file, "    {\"name\": \"%s\", \"iterations\": %llu, \"median\": %.3f, \"mad\": %.3f, \"samples\": [",
+                     result.name.c_str(), static_cast<unsigned long long>(result.iterations), result.median, result.mad);
+        for(size_t rep = 0; rep < result.nsPerOp.size(); ++rep){
+            std::fprintf(file, "%s%.3f", rep == 0 ? "" : ", ", result.nsPerOp[rep]);
+        }
+        std::fprintf(file, "]}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    return std::fclose(file) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    string jsonFile;
+    string filter;
+    int reps = 5;
+    double minMillis = 100.0;
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(std::strcmp(argv[i], "--json") == 0){
+            jsonFile = argv[i + 1];
+        } else if(std::strcmp(argv[i], "--reps") == 0){
+            reps = std::max(1, std::atoi(argv[i + 1]));
+        } else if(std::strcmp(argv[i], "--min-time") == 0){
+            minMillis = std::max(1.0, std::atof(argv[i + 1]));
+        } else if(std::strcmp(argv[i], "--filter") == 0){
+            filter = argv[i + 1];
+        }
+    }
+
+    // generated levels live in the temp directory for the length of the run
+    std::filesystem::path tempDir = std::filesystem::temp_directory_path();
+    vector<std::pair<string, string>> files;
+    for(const char* shipped : SHIPPED_LEVELS){
+        if(std::filesystem::exists(shipped)){
+            files.emplace_back(string(shipped).substr(0, std::strlen(shipped) - 4), shipped);
+        }
+    }
+    vector<string> generated;
+    for(int size : GENERATED_SIZES){
+        LevelSpec spec;
+        spec.rows = size;
+        spec.cols = size;
+        spec.seed = static_cast<uint64_t>(size);
+        string name = "gen" + std::to_string(size);
+        string path = (tempDir / ("dungeon_bench_" + name + ".txt")).string();
+        if(writeLevel(path, spec)){
+            files.emplace_back(name, path);
+            generated.push_back(path);
+        }
+    }
+
+    // levels the in-memory benchmarks share
+    vector<LoadedLevel> levels(files.size());
+    for(size_t i = 0; i < files.size(); ++i){
+        loadInto(levels[i], files[i].first, files[i].second);
+    }
+    const int RAY_LENGTHS[] = {4, 64, 1024};
+    vector<LoadedLevel> rays(3);
+    for(size_t i = 0; i < rays.size(); ++i){
+        rayLevel(rays[i], RAY_LENGTHS[i]);
+    }
+    const double DENSITIES[] = {0.01, 0.05, 0.20};
+    vector<LoadedLevel> crowds(3);
+    for(size_t i = 0; i < crowds.size(); ++i){
+        LevelSpec spec;
+        spec.rows = 257;
+        spec.cols = 257;
+        spec.pillars = 0.0;
+        spec.monsters = DENSITIES[i];
+        spec.seed = 100 + i;
+        string path = (tempDir / ("dungeon_bench_crowd" + std::to_string(i) + ".txt")).string();
+        writeLevel(path, spec);
+        generated.push_back(path);
+        loadInto(crowds[i], "monsters" + std::to_string(static_cast<int>(DENSITIES[i] * 100)) + "pct", path);
+    }
+
+    vector<Benchmark> benchmarks;
+    for(const auto& file : files){
+        benchmarks.push_back(loadBenchmark(file.first, file.second));
+    }
+    for(int size : {32, 256, 1024}){
+        benchmarks.push_back(createBenchmark(size));
+    }
+    for(const LoadedLevel& level : levels){
+        if(level.map == nullptr){
+            continue;
+        }
+        benchmarks.push_back(resizeBenchmark("resizeMap/" + level.name, level, 1));
+        benchmarks.push_back(walkBenchmark(level));
+        benchmarks.push_back(outputBenchmark(level));
+    }
+    if(!levels.empty() && levels.front().map != nullptr){
+        benchmarks.push_back(resizeBenchmark("resizeMap/" + levels.front().name + "/x4", levels.front(), 4));
+    }
+    for(const LoadedLevel& level : rays){
+        benchmarks.push_back(attackBenchmark("doMonsterAttack/" + level.name, level));
+    }
+    for(const LoadedLevel& level : crowds){
+        if(level.map != nullptr){
+            benchmarks.push_back(attackBenchmark("doMonsterAttack/" + level.name, level));
+        }
+    }
+    for(const auto& dungeon : SHIPPED_DUNGEONS){
+        if(std::filesystem::exists(roomFileName(dungeon.first, 1))){
+            benchmarks.push_back(stepBenchmark(dungeon.first, dungeon.second));
+        }
+    }
+    bool shipped = true;
+    for(const auto& dungeon : SHIPPED_DUNGEONS){
+        for(int room = 1; room <= dungeon.second; ++room){
+            shipped = shipped && std::filesystem::exists(roomFileName(dungeon.first, room));
+        }
+    }
+    if(shipped){
+        int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        benchmarks.push_back(envBenchmark(256, 1, OBS_TILES, "tiles"));
+        benchmarks.push_back(envBenchmark(256, 1, OBS_BITS, "bits"));
+        benchmarks.push_back(envBenchmark(4096, cores, OBS_BITS, "bits"));
+    }
+
+    vector<BenchResult> results;
+    std::printf("%-44s %12s %14s %10s\n", "benchmark", "iterations", "median ns/op", "mad");
+    for(const Benchmark& benchmark : benchmarks){
+        if(!filter.empty() && benchmark.name.find(filter) == string::npos){
+            continue;
+        }
+        BenchResult result = measure(benchmark, reps, minMillis * 1e6);
+        std::printf("%-44s %12llu %14.1f %10.1f\n", result.name.c_str(),
+                    static_cast<unsigned long long>(result.iterations), result.median, result.mad);
+        std::fflush(stdout);
+        results.push_back(result);
+    }
+
+    for(const string& path : generated){
+        std::remove(path.c_str());
+    }
+    if(!jsonFile.empty() && !writeJson(jsonFile, results, reps)){
+        std::fprintf(stderr, "could not write %s\n", jsonFile.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,260 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "levelgen.h"
+#include "logic.h"
+#include "multiplayer.h"
+#include "pmap.h"
+#include "session.h"
+
+using std::string;
+
+// Randomized equivalence checks of the alternative turn engines, the persistent map and a
+// one-player MultiSession, against stepSession: plays generated levels with random commands
+// through each engine and through a plain session, and compares the outcome of every turn
+// and the whole map after it.
+// Build from the repository root:
+//   g++ -std=c++20 -O2 -pthread -I. -o dungeon_equivcheck tools/equivcheck.cpp tools/levelgen.cpp $(ls *.cpp | grep -v dungeoncrawler.cpp)
+// Run:
+//   ./dungeon_equivcheck [--runs <count>] [--turns <count>] [--seed <number>]
+// Exit status is 0 if every engine agreed with stepSession, 1 on the first difference.
+
+// a map grown beyond this many cells by amulets ends the run
+const long long MAX_CELLS = 1LL << 20;
+
+/**
+ * splitmix64 step.
+ * @param   state       Generator state.
+ * @return  next random value.
+ * @updates state
+ */
+static uint64_t nextRandom(uint64_t& state) {
+    state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @param   random      Generator of the commands.
+ * @return  a movement or stay command.
+ * @updates random
+ */
+static char randomCommand(uint64_t& random) {
+    static const char MOVES[5] = {MOVE_UP, MOVE_LEFT, MOVE_DOWN, MOVE_RIGHT, INPUT_STAY};
+    return MOVES[nextRandom(random) % 5];
+}
+
+/**
+ * Generate a level and enter it with a session that keeps no journal.
+ * @param   spec        Level to generate.
+ * @param   session     Session to start.
+ * @param   level       Parsed level.
+ * @return  false if the generated level did not parse.
+ * @updates session, level
+ */
+static bool startLevel(const LevelSpec& spec, GameSession& session, LevelTemplate& level) {
+    string text = generateLevel(spec);
+    if(!parseLevel(text.data(), text.size(), level)){
+        return false;
+    }
+    session.dungeon = "generated";
+    session.total_rooms = 1;
+    session.current_room = 1;
+    session.total_moves = 0;
+    session.player.treasure = 0;
+    return enterLevel(session, level);
+}
+
+/**
+ * @param   flat        Regular map.
+ * @param   map         Persistent map of the same size.
+ * @return  true if every tile matches.
+ */
+static bool sameTiles(char** flat, const PersistentMap& map) {
+    for(int row = 0; row < map.maxRow; ++row){
+        for(int col = 0; col < map.maxCol; ++col){
+            if(flat[row][col] != tileAt(map, row, col)){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Play one level through stepSession and persistentStep side by side. A copy of the
+ * persistent state is branched off halfway and must be unchanged by the turns played after it.
+ * @param   spec        Level to play.
+ * @param   turns       Most turns to play.
+ * @param   random      Generator of the commands.
+ * @param   problem     Description of the first difference.
+ * @return  false if the engines disagreed.
+ * @updates random, problem
+ */
+static bool checkPersistent(const LevelSpec& spec, int turns, uint64_t& random, string& problem) {
+    GameSession session;
+    LevelTemplate level;
+    if(!startLevel(spec, session, level)){
+        problem = "generated level did not parse";
+        return false;
+    }
+    PersistentState state;
+    if(!makePersistentMap(session.map, session.maxRow, session.maxCol, state.map)){
+        problem = "generated level holds listed monsters";
+        return false;
+    }
+    state.player = session.player;
+
+    PersistentState branch;
+    char** branchTiles = nullptr;
+    int branchRows = 0;
+    bool same = true;
+    for(int turn = 0; turn < turns && same; ++turn){
+        if(turn == turns / 2){
+            branch = state;
+            branchTiles = materializeMap(branch.map);
+            branchRows = branch.map.maxRow;
+        }
+        char input = randomCommand(random);
+        int expected = stepSession(session, input);
+        int got = persistentStep(state, input);
+        same = got == expected && state.status == session.status && state.total_moves == session.total_moves
+               && state.player.row == session.player.row && state.player.col == session.player.col
+               && state.player.treasure == session.player.treasure;
+        if(!same){
+            problem = "turn " + std::to_string(turn) + ": outcome or player differs";
+            break;
+        }
+        if(expected != TURN_CONTINUE){
+            break;
+        }
+        same = state.map.maxRow == session.maxRow && state.map.maxCol == session.maxCol && sameTiles(session.map, state.map);
+        if(!same){
+            problem = "turn " + std::to_string(turn) + ": map differs";
+        }
+        if(static_cast<long long>(session.maxRow) * session.maxCol > MAX_CELLS){
+            break;
+        }
+    }
+    if(same && branchTiles != nullptr && !sameTiles(branchTiles, branch.map)){
+        same = false;
+        problem = "a branched state changed after later turns";
+    }
+    deleteMap(branchTiles, branchRows);
+    return same;
+}
+
+/**
+ * @param   a           Regular map.
+ * @param   b           Regular map of the same size.
+ * @param   maxRow      Number of rows.
+ * @param   maxCol      Number of columns.
+ * @return  true if every tile matches.
+ */
+static bool sameMaps(char** a, char** b, int maxRow, int maxCol) {
+    for(int row = 0; row < maxRow; ++row){
+        for(int col = 0; col < maxCol; ++col){
+            if(a[row][col] != b[row][col]){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Play one level through stepSession and a one-player MultiSession side by side.
+ * @param   spec        Level to play.
+ * @param   turns       Most turns to play.
+ * @param   random      Generator of the commands.
+ * @param   problem     Description of the first difference.
+ * @return  false if the engines disagreed.
+ * @updates random, problem
+ */
+static bool checkMulti(const LevelSpec& spec, int turns, uint64_t& random, string& problem) {
+    GameSession session;
+    LevelTemplate level;
+    MultiSession multi;
+    if(!startLevel(spec, session, level) || !startMultiSession(multi, level, 1)){
+        problem = "generated level did not start";
+        return false;
+    }
+    for(int turn = 0; turn < turns; ++turn){
+        char input = randomCommand(random);
+        int expected = stepSession(session, input);
+        stepMultiSession(multi, &input);
+        const Player& player = multi.players[0];
+        int state = multi.state[0];
+        bool same = multi.status[0] == session.status && player.row == session.player.row
+                    && player.col == session.player.col && player.treasure == session.player.treasure;
+        same = same && (expected == TURN_LEAVE ? state == PLAYER_LEFT
+                        : expected == TURN_ESCAPE ? state == PLAYER_ESCAPED
+                        : expected == TURN_DIED ? state == PLAYER_DEAD
+                        : expected == TURN_CONTINUE ? state == PLAYER_ACTIVE : true);
+        if(!same){
+            problem = "turn " + std::to_string(turn) + ": outcome or player differs";
+            return false;
+        }
+        if(expected != TURN_CONTINUE){
+            return true;
+        }
+        if(multi.maxRow != session.maxRow || multi.maxCol != session.maxCol
+           || !sameMaps(multi.map, session.map, session.maxRow, session.maxCol)){
+            problem = "turn " + std::to_string(turn) + ": map differs";
+            return false;
+        }
+        if(static_cast<long long>(session.maxRow) * session.maxCol > MAX_CELLS){
+            return true;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int runs = 200;
+    int turns = 400;
+    uint64_t seed = 1;
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(std::strcmp(argv[i], "--runs") == 0){
+            runs = std::atoi(argv[i + 1]);
+        } else if(std::strcmp(argv[i], "--turns") == 0){
+            turns = std::atoi(argv[i + 1]);
+        } else if(std::strcmp(argv[i], "--seed") == 0){
+            seed = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+    }
+
+    // small amulet-heavy rooms, ordinary rooms, and rooms large enough for a two-level tree
+    LevelSpec specs[3];
+    specs[0].rows = 10;
+    specs[0].cols = 10;
+    specs[0].amulets = 0.08;
+    specs[1].monsters = 0.05;
+    specs[2].rows = 96;
+    specs[2].cols = 200;
+    specs[2].amulets = 0.001;
+
+    uint64_t random = seed;
+    for(int run = 0; run < runs; ++run){
+        for(LevelSpec& spec : specs){
+            spec.seed = nextRandom(random);
+            string problem;
+            if(!checkPersistent(spec, turns, random, problem)){
+                std::printf("persistent map differs from stepSession on a %dx%d level, seed %llu: %s\n", spec.rows, spec.cols,
+                            static_cast<unsigned long long>(spec.seed), problem.c_str());
+                return 1;
+            }
+            if(!checkMulti(spec, turns, random, problem)){
+                std::printf("one-player MultiSession differs from stepSession on a %dx%d level, seed %llu: %s\n", spec.rows, spec.cols,
+                            static_cast<unsigned long long>(spec.seed), problem.c_str());
+                return 1;
+            }
+        }
+    }
+    std::printf("%d runs: every engine agreed with stepSession\n", runs);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <cstdio>
+#include "logic.h"
+#include "monsters.h"
+#include "levelgen.h"
+
+using std::string;
+
+/**
+ * splitmix64 step, so the same spec always gives the same level.
+ * @param   state       Generator state.
+ * @return  next random value.
+ * @updates state
+ */
+static uint64_t nextRandom(uint64_t& state) {
+    state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Generate the text of a valid level: the player starts in the middle, a door sits in the
+ * top-left corner and the exit in the bottom-right one, and every other cell is drawn at
+ * random according to the densities of the spec.
+ * @param   spec        Level size, densities and seed.
+ * @return  level text in the format loadLevel reads.
+ */
+string generateLevel(const LevelSpec& spec) {
+    uint64_t state = spec.seed;
+    int startRow = spec.rows / 2;
+    int startCol = spec.cols / 2;
+    string text = std::to_string(spec.rows) + " " + std::to_string(spec.cols) + "\n"
+                  + std::to_string(startRow) + " " + std::to_string(startCol) + "\n";
+    text.reserve(text.size() + static_cast<size_t>(spec.rows) * (spec.cols * 2 + 1));
+    const double pillarEdge = spec.pillars;
+    const double monsterEdge = pillarEdge + spec.monsters;
+    const double treasureEdge = monsterEdge + spec.treasures;
+    const double amuletEdge = treasureEdge + spec.amulets;
+    const double listedEdge = amuletEdge + spec.listed;
+    const char listedTiles[4] = {TILE_CHASER, TILE_FAST, TILE_SLEEPER, TILE_HUGGER};
+    for(int row = 0; row < spec.rows; ++row){
+        for(int col = 0; col < spec.cols; ++col){
+            double draw = static_cast<double>(nextRandom(state) >> 11) / static_cast<double>(1ULL << 53);
+            char tile = TILE_OPEN;
+            if(row == 0 && col == 0){
+                tile = TILE_DOOR;
+            } else if(row == spec.rows - 1 && col == spec.cols - 1){
+                tile = TILE_EXIT;
+            } else if(row == startRow && col == startCol){
+                tile = TILE_OPEN;
+            } else if(draw < pillarEdge){
+                tile = TILE_PILLAR;
+            } else if(draw < monsterEdge){
+                tile = TILE_MONSTER;
+            } else if(draw < treasureEdge){
+                tile = TILE_TREASURE;
+            } else if(draw < amuletEdge){
+                tile = TILE_AMULET;
+            } else if(draw < listedEdge){
+                tile = listedTiles[nextRandom(state) % 4];
+            }
+            text += tile;
+            text += col + 1 < spec.cols ? ' ' : '\n';
+        }
+    }
+    return text;
+}
+
+/**
+ * Generate a level and write it to a file.
+ * @param   fileName    File to create or overwrite.
+ * @param   spec        Level size, densities and seed.
+ * @return  true if the whole level was written.
+ */
+bool writeLevel(const string& fileName, const LevelSpec& spec) {
+    string text = generateLevel(spec);
+    FILE* file = std::fopen(fileName.c_str(), "wb");
+    if(file == nullptr){
+        return false;
+    }
+    bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    return std::fclose(file) == 0 && written;
+}
@@ -0,0 +1,23 @@
+#ifndef LEVELGEN_H
+#define LEVELGEN_H
+#include <cstdint>
+#include <string>
+
+// shape and contents of a generated level; densities are fractions of all cells
+struct LevelSpec {
+    int rows = 32;
+    int cols = 32;
+    double pillars = 0.15;
+    double monsters = 0.02;
+    double treasures = 0.01;
+    double amulets = 0.0;
+    uint64_t seed = 1;
+    double listed = 0.0;        // chasers, fast monsters, sleepers and huggers, in equal shares
+};
+
+// function signatures
+std::string generateLevel(const LevelSpec& spec);
+
+bool writeLevel(const std::string& fileName, const LevelSpec& spec);
+
+#endif
@@ -0,0 +1,176 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+
+using std::string;
+
+// Compares a dungeon_bench JSON run against a baseline and fails on regressions of the gated
+// benchmarks, and when a gated benchmark of the baseline, or every benchmark of a gated kind, is missing.
+// Build from the repository root:
+//   g++ -std=c++20 -O2 -o perfgate tools/perfgate.cpp
+// Run:
+//   ./perfgate <baseline.json> <current.json> [--threshold <percent>] [--sigmas <count>]
+// Exit status is 0 when nothing gated regressed, 1 on a regression, 2 if a file cannot be read.
+
+// benchmarks whose regressions fail the gate; everything else is reported only
+static const char* GATED_PREFIXES[] = {"loadLevel/", "resizeMap/", "stepSession/"};
+
+// MAD times this estimates the standard deviation of normally distributed samples
+static const double MAD_TO_SIGMA = 1.4826;
+
+// summary of one benchmark in a run
+struct Summary {
+    double median = 0.0;
+    double mad = 0.0;
+};
+
+/**
+ * Read the number following a key on a line of dungeon_bench output.
+ * @param   line        Line holding one benchmark object.
+ * @param   key         Quoted key, e.g. "\"median\"".
+ * @param   value       Number read.
+ * @return  true if the key was found.
+ * @updates value
+ */
+static bool readNumber(const string& line, const char* key, double& value) {
+    size_t at = line.find(key);
+    if(at == string::npos){
+        return false;
+    }
+    at = line.find(':', at);
+    if(at == string::npos){
+        return false;
+    }
+    value = std::strtod(line.c_str() + at + 1, nullptr);
+    return true;
+}
+
+/**
+ * Read the benchmarks of a dungeon_bench JSON file, which writes one benchmark object per line.
+ * @param   fileName    JSON file.
+ * @param   runs        Median and MAD by benchmark name.
+ * @return  false if the file cannot be opened.
+ * @updates runs
+ */
+static bool readRun(const string& fileName, std::map<string, Summary>& runs) {
+    std::ifstream fin(fileName);
+    if(!fin.is_open()){
+        return false;
+    }
+    string line;
+    const string nameKey = "\"name\": \"";
+    while(std::getline(fin, line)){
+        size_t at = line.find(nameKey);
+        if(at == string::npos){
+            continue;
+        }
+        size_t begin = at + nameKey.size();
+        size_t end = line.find('"', begin);
+        if(end == string::npos){
+            continue;
+        }
+        Summary summary;
+        if(readNumber(line, "\"median\"", summary.median) && readNumber(line, "\"mad\"", summary.mad)){
+            runs[line.substr(begin, end - begin)] = summary;
+        }
+    }
+    return true;
+}
+
+/**
+ * @param   name        Benchmark name.
+ * @return  true if a regression of the benchmark fails the gate.
+ */
+static bool gated(const string& name) {
+    for(const char* prefix : GATED_PREFIXES){
+        if(name.compare(0, std::strlen(prefix), prefix) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc < 3){
+        std::fprintf(stderr, "usage: %s <baseline.json> <current.json> [--threshold <percent>] [--sigmas <count>]\n", argv[0]);
+        return 2;
+    }
+    double threshold = 15.0;
+    double sigmas = 3.0;
+    for(int i = 3; i + 1 < argc; i += 2){
+        if(std::strcmp(argv[i], "--threshold") == 0){
+            threshold = std::atof(argv[i + 1]);
+        } else if(std::strcmp(argv[i], "--sigmas") == 0){
+            sigmas = std::atof(argv[i + 1]);
+        }
+    }
+
+    std::map<string, Summary> baseline;
+    std::map<string, Summary> current;
+    if(!readRun(argv[1], baseline) || !readRun(argv[2], current)){
+        std::fprintf(stderr, "cannot read %s or %s\n", argv[1], argv[2]);
+        return 2;
+    }
+
+    // a change counts only if it beats both the relative threshold and the run-to-run noise
+    int regressions = 0;
+    std::printf("%-44s %14s %14s %9s %10s  %s\n", "benchmark", "baseline ns", "current ns", "change", "noise", "verdict");
+    for(const auto& entry : current){
+        const string& name = entry.first;
+        const Summary& now = entry.second;
+        auto before = baseline.find(name);
+        if(before == baseline.end()){
+            std::printf("%-44s %14s %14.1f %9s %10s  new\n", name.c_str(), "-", now.median, "-", "-");
+            continue;
+        }
+        const Summary& was = before->second;
+        double delta = now.median - was.median;
+        double percent = was.median > 0.0 ? delta / was.median * 100.0 : 0.0;
+        double noise = sigmas * MAD_TO_SIGMA * std::sqrt(was.mad * was.mad + now.mad * now.mad);
+        bool slower = percent > threshold && delta > noise;
+        bool faster = -percent > threshold && -delta > noise;
+        const char* verdict = "ok";
+        if(slower && gated(name)){
+            verdict = "REGRESSED";
+            regressions++;
+        } else if(slower){
+            verdict = "slower";
+        } else if(faster){
+            verdict = "faster";
+        }
+        std::printf("%-44s %14.1f %14.1f %+8.1f%% %10.1f  %s\n", name.c_str(), was.median, now.median, percent, noise, verdict);
+    }
+    // a gated benchmark that was renamed or dropped would otherwise switch its gate off unnoticed
+    int missing = 0;
+    for(const auto& entry : baseline){
+        if(current.find(entry.first) == current.end()){
+            bool counted = gated(entry.first);
+            missing += counted ? 1 : 0;
+            std::printf("%-44s %14.1f %14s %9s %10s  %s\n", entry.first.c_str(), entry.second.median, "-", "-", "-",
+                        counted ? "MISSING" : "missing");
+        }
+    }
+    for(const char* prefix : GATED_PREFIXES){
+        auto first = current.lower_bound(prefix);
+        if(first == current.end() || first->first.compare(0, std::strlen(prefix), prefix) != 0){
+            std::printf("%-44s %14s %14s %9s %10s  MISSING\n", (string(prefix) + "*").c_str(), "-", "-", "-", "-");
+            missing++;
+        }
+    }
+
+    if(regressions > 0 || missing > 0){
+        if(regressions > 0){
+            std::printf("%d gated benchmark%s regressed by more than %.1f%%\n", regressions, regressions > 1 ? "s" : "", threshold);
+        }
+        if(missing > 0){
+            std::printf("%d gated benchmark%s missing from the current run\n", missing, missing > 1 ? "s are" : " is");
+        }
+        return 1;
+    }
+    std::printf("no gated regressions\n");
+    return 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Performance regression gate: builds the benchmarks, runs them and compares the run with
+# tools/bench_baseline.json. Fails when loadLevel, resizeMap or stepSession got slower by
+# more than the threshold and the run-to-run noise.
+#   tools/perfgate.sh [--update] [--threshold <percent>]
+# --update replaces the baseline with the new run instead of comparing; commit it together
+# with the change that moved the numbers, and record baselines on the machine the gate runs on.
+set -e
+cd "$(dirname "$0")/.."
+
+update=0
+threshold=15
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --update) update=1 ;;
+        --threshold) shift; threshold="$1" ;;
+    esac
+    shift
+done
+
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+g++ -std=c++20 -O2 -pthread -I. -o "$build/dungeon_bench" tools/bench.cpp tools/levelgen.cpp $(ls *.cpp | grep -v dungeoncrawler.cpp)
+g++ -std=c++20 -O2 -o "$build/perfgate" tools/perfgate.cpp
+
+"$build/dungeon_bench" --reps 7 --json "$build/current.json" > /dev/null
+if [ "$update" -eq 1 ]; then
+    cp "$build/current.json" tools/bench_baseline.json
+    echo "baseline updated: tools/bench_baseline.json"
+    exit 0
+fi
+"$build/perfgate" tools/bench_baseline.json "$build/current.json" --threshold "$threshold"
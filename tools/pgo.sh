@@ -0,0 +1,72 @@
+#!/bin/sh
+# Profile-guided optimization: builds the game and the benchmarks with instrumentation, runs
+# the training workload (tools/pgotrain.cpp), rebuilds them with the profile and compares the
+# benchmarks against a plain -O2 build with perfgate.
+#   tools/pgo.sh [instrument|train|optimize|compare|all] [--rounds <count>] [--out <dir>]
+# Each step needs the ones before it; all (the default) runs them in order. Binaries land in
+# <dir> (default _pgo): dungeon_pgotrain instrumented, dungeoncrawler and dungeon_bench
+# optimized with the profile, dungeon_bench_plain without it.
+set -e
+cd "$(dirname "$0")/.."
+
+step=all
+rounds=20
+out=_pgo
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --rounds) shift; rounds="$1" ;;
+        --out) shift; out="$1" ;;
+        *) step="$1" ;;
+    esac
+    shift
+done
+
+flags="-std=c++20 -O2 -pthread -I."
+sources="$(ls *.cpp | grep -v dungeoncrawler.cpp) tools/levelgen.cpp"
+
+# compile the shared sources into <dir>, one object per source so each finds its own profile
+compile() {
+    dir="$1"
+    shift
+    mkdir -p "$dir"
+    for source in $sources; do
+        g++ $flags "$@" -c "$source" -o "$dir/$(basename "$source" .cpp).o"
+    done
+}
+
+instrument() {
+    rm -rf "$out/obj"
+    compile "$out/obj" -fprofile-generate -fprofile-update=prefer-atomic
+    g++ $flags -fprofile-generate -o "$out/dungeon_pgotrain" tools/pgotrain.cpp "$out"/obj/*.o
+}
+
+train() {
+    rm -f "$out"/obj/*.gcda
+    "$out/dungeon_pgotrain" "$rounds"
+}
+
+optimize() {
+    # the objects are rebuilt at the same paths, where the training left their .gcda files
+    compile "$out/obj" -fprofile-use -fprofile-partial-training -fprofile-correction -Wno-missing-profile
+    g++ $flags -o "$out/dungeoncrawler" dungeoncrawler.cpp "$out"/obj/*.o
+    g++ $flags -o "$out/dungeon_bench" tools/bench.cpp "$out"/obj/*.o
+}
+
+compare() {
+    compile "$out/plain"
+    g++ $flags -o "$out/dungeon_bench_plain" tools/bench.cpp "$out"/plain/*.o
+    g++ -std=c++20 -O2 -o "$out/perfgate" tools/perfgate.cpp
+    "$out/dungeon_bench_plain" --reps 7 --json "$out/plain.json" > /dev/null
+    "$out/dungeon_bench" --reps 7 --json "$out/pgo.json" > /dev/null
+    # "faster" marks the gains; a regression is reported but does not fail the build
+    "$out/perfgate" "$out/plain.json" "$out/pgo.json" || true
+}
+
+case "$step" in
+    instrument) instrument ;;
+    train) train ;;
+    optimize) optimize ;;
+    compare) compare ;;
+    all) instrument; train; optimize; compare ;;
+    *) echo "unknown step: $step" >&2; exit 2 ;;
+esac
@@ -0,0 +1,183 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+#include "helper.h"
+#include "journal.h"
+#include "levelgen.h"
+#include "logic.h"
+#include "session.h"
+
+using std::string;
+
+// Training workload for profile-guided builds: plays the shipped dungeons and generated levels
+// headlessly through the paths the game takes, so the profile covers loading, player moves,
+// monster ticks, amulet resizes and rendering in realistic proportions. tools/pgo.sh builds and
+// runs it; run it from the repository root, so the shipped levels are found:
+//   ./dungeon_pgotrain [rounds]
+
+// shipped dungeons and their number of rooms
+static const std::pair<const char*, int> SHIPPED_DUNGEONS[] = {{"tutorial", 4}, {"easy", 2}, {"hard", 3}};
+
+// shipped level files, also loaded directly through loadLevel
+static const char* SHIPPED_LEVELS[] = {
+    "tutorial1.txt", "tutorial2.txt", "tutorial3.txt", "tutorial4.txt",
+    "easy1.txt", "easy2.txt", "hard1.txt", "hard2.txt", "hard3.txt"
+};
+
+// commands of the scripted players; undo and redo walk the journal
+static const char COMMANDS[] = {MOVE_UP, MOVE_LEFT, MOVE_DOWN, MOVE_RIGHT, MOVE_DOWN, MOVE_RIGHT, INPUT_STAY, INPUT_UNDO, INPUT_REDO};
+
+// turns played per shipped dungeon and per generated level in each round
+const int SHIPPED_TURNS = 400;
+const int GENERATED_TURNS = 200;
+
+// a map grown beyond this many cells by amulets is reloaded
+const long long MAX_CELLS = 1LL << 21;
+
+/**
+ * splitmix64 step.
+ * @param   state       Generator state.
+ * @return  next random value.
+ * @updates state
+ */
+static uint64_t nextRandom(uint64_t& state) {
+    state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Play a shipped dungeon the way the console game does, frames included, restarting it
+ * whenever the game ends.
+ * @param   dungeon     Dungeon name.
+ * @param   rooms       Number of rooms.
+ * @param   fog         Sight radius, 0 for no fog of war.
+ * @param   random      Generator of the commands.
+ * @return  bytes of frames rendered, so the work cannot be optimized away.
+ * @updates random
+ */
+static size_t playShipped(const char* dungeon, int rooms, int fog, uint64_t& random) {
+    Journal journal;
+    GameSession session;
+    session.journal = &journal;
+    session.fog.radius = fog;
+    string frame;
+    size_t rendered = 0;
+    int result = beginGame(session, dungeon, rooms, frame);
+    for(int turn = 0; turn < SHIPPED_TURNS && result == GAME_RUNNING; ++turn){
+        rendered += frame.size();
+        frame.clear();
+        result = playTurn(session, COMMANDS[nextRandom(random) % sizeof(COMMANDS)], frame);
+        if(result != GAME_RUNNING){
+            rendered += frame.size();
+            frame.clear();
+            result = beginGame(session, dungeon, rooms, frame);
+        }
+    }
+    return rendered + frame.size();
+}
+
+/**
+ * Load a level file through logic.cpp, grow it twice and render it.
+ * @param   fileName    Level file.
+ * @return  bytes rendered.
+ */
+static size_t loadAndResize(const string& fileName) {
+    int maxRow = 0;
+    int maxCol = 0;
+    Player player;
+    char** map = loadLevel(fileName, maxRow, maxCol, player);
+    if(map == nullptr){
+        return 0;
+    }
+    for(int grow = 0; grow < 2 && map != nullptr; ++grow){
+        map = resizeMap(map, maxRow, maxCol);
+    }
+    string frame;
+    if(map != nullptr){
+        renderMap(frame, map, maxRow, maxCol);
+    }
+    deleteMap(map, maxRow);
+    return frame.size();
+}
+
+/**
+ * Play a generated level through stepSession and renderView, re-entering it when the game
+ * ends or amulets grow the map too far.
+ * @param   spec        Level to generate.
+ * @param   fileName    Scratch file the level is written to, to train the file readers too.
+ * @param   random      Generator of the commands.
+ * @return  bytes of frames rendered.
+ * @updates random
+ */
+static size_t playGenerated(const LevelSpec& spec, const string& fileName, uint64_t& random) {
+    if(!writeLevel(fileName, spec)){
+        return 0;
+    }
+    size_t rendered = loadAndResize(fileName);
+    LevelTemplate level;
+    if(readLevelFile(fileName, level) != LEVEL_OK){
+        return rendered;
+    }
+    GameSession session;
+    session.fog.radius = spec.seed % 2 == 0 ? FOG_DEFAULT_RADIUS : 0;
+    enterLevel(session, level);
+    string frame;
+    for(int turn = 0; turn < GENERATED_TURNS; ++turn){
+        int outcome = stepSession(session, COMMANDS[nextRandom(random) % 7]);
+        frame.clear();
+        renderView(frame, session);
+        rendered += frame.size();
+        if(outcome != TURN_CONTINUE || static_cast<long long>(session.maxRow) * session.maxCol > MAX_CELLS){
+            enterLevel(session, level);
+        }
+    }
+    return rendered;
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 1 ? std::atoi(argv[1]) : 20;
+    string scratch = (std::filesystem::temp_directory_path() / ("dungeon_pgotrain_" + std::to_string(getpid()) + ".txt")).string();
+    uint64_t random = 1;
+    size_t rendered = 0;
+    for(int round = 0; round < rounds; ++round){
+        int fog = round % 3 == 2 ? FOG_DEFAULT_RADIUS : 0;
+        for(const auto& dungeon : SHIPPED_DUNGEONS){
+            rendered += playShipped(dungeon.first, dungeon.second, fog, random);
+        }
+        for(const char* fileName : SHIPPED_LEVELS){
+            rendered += loadAndResize(fileName);
+        }
+
+        // ordinary rooms, amulet-heavy rooms, listed monsters and one larger level per round
+        LevelSpec spec;
+        spec.seed = nextRandom(random);
+        spec.amulets = 0.002;
+        rendered += playGenerated(spec, scratch, random);
+        spec.rows = 16;
+        spec.cols = 16;
+        spec.amulets = 0.05;
+        spec.seed = nextRandom(random);
+        rendered += playGenerated(spec, scratch, random);
+        spec.rows = 64;
+        spec.cols = 64;
+        spec.amulets = 0.0;
+        spec.monsters = 0.01;
+        spec.listed = 0.03;
+        spec.seed = nextRandom(random);
+        rendered += playGenerated(spec, scratch, random);
+        spec.rows = 256;
+        spec.cols = 256;
+        spec.listed = 0.002;
+        spec.seed = nextRandom(random);
+        rendered += playGenerated(spec, scratch, random);
+    }
+    std::remove(scratch.c_str());
+    std::printf("trained %d rounds, %zu bytes rendered\n", rounds, rendered);
+    return 0;
+}
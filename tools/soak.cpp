@@ -0,0 +1,598 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "alloc.h"
+#include "journal.h"
+#include "latency.h"
+#include "levelgen.h"
+#include "logic.h"
+#include "monsters.h"
+#include "session.h"
+
+using std::string;
+using std::vector;
+
+// Soak and stress test: keeps thousands of headless sessions playing generated dungeons for as
+// long as asked, checks the map after their turns, and watches memory and turn latency drift.
+// Build from the repository root (add -fsanitize=address to catch leaks, or
+// -DDUNGEON_ALLOC_ACCOUNTING to also track live heap bytes):
+//   g++ -std=c++20 -O2 -pthread -I. -o dungeon_soak tools/soak.cpp tools/levelgen.cpp $(ls *.cpp | grep -v dungeoncrawler.cpp)
+// Run:
+//   ./dungeon_soak [--sessions <count>] [--threads <count>] [--seconds <count>] [--report <seconds>]
+//                  [--policy random|bot|mixed] [--seed <number>] [--max-p99-drift <ratio>] [--max-rss-growth <ratio>]
+// Exit status is 0 if every check passed, 1 on an invalid state or too much drift, 2 on bad options.
+
+// kinds of generated dungeons, picked at random by weight whenever a session starts
+struct Scenario {
+    const char* name = "";
+    int weight = 0;
+    LevelSpec spec{};
+};
+
+// a map grown beyond this many cells by amulets is abandoned, so amulet chains cannot exhaust memory
+const long long MAX_CELLS = 1LL << 20;
+
+// turns a session may play before it is replaced by a fresh one
+const int MAX_TURNS = 4000;
+
+// one in this many session starts also feeds loadLevel a broken level file
+const int BROKEN_LEVEL_EVERY = 16;
+
+// a full scan of the map runs every this many turns, and after every resize, undo and redo
+const int FULL_SCAN_EVERY = 64;
+
+// policies choosing the commands of a session
+const int POLICY_RANDOM = 0;   // any command, uniformly
+const int POLICY_BOT    = 1;   // mostly heads for the exit, sometimes undoes and redoes
+const int POLICY_MIXED  = 2;   // half the sessions of each
+
+// one headless game and what the checks remember about it
+struct SoakSession {
+    std::unique_ptr<Journal> journal{};
+    std::unique_ptr<GameSession> session{};
+    const char* scenario = "";
+    uint64_t seed = 0;
+    int policy = POLICY_RANDOM;
+    int turns = 0;
+    size_t monsters = 0;        // monster tiles at the last full scan
+};
+
+// what a worker measured since the last report
+struct SoakWindow {
+    LatencyHistogram latency{};
+    uint64_t turns = 0;
+    uint64_t sessions = 0;      // sessions started
+    uint64_t resizes = 0;
+    uint64_t brokenLevels = 0;  // broken level files loadLevel rejected
+};
+
+// one thread's sessions and its measurements, swapped out by the reporter under lock
+struct SoakWorker {
+    int index = 0;
+    vector<SoakSession> sessions{};
+    uint64_t random = 0;
+    std::mutex lock{};
+    SoakWindow window{};
+    string failure{};           // first invalid state found, empty while all is well
+    std::thread thread{};
+};
+
+static Scenario scenarios[5];
+
+/**
+ * splitmix64 step.
+ * @param   state       Generator state.
+ * @return  next random value.
+ * @updates state
+ */
+static uint64_t nextRandom(uint64_t& state) {
+    state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Fill in the scenarios: ordinary rooms, amulet chains, a long corridor packed with monsters,
+ * rooms of listed monsters and a few large levels.
+ */
+static void setupScenarios() {
+    scenarios[0].name = "mixed";
+    scenarios[0].weight = 40;
+    scenarios[0].spec.listed = 0.02;
+    scenarios[0].spec.amulets = 0.005;
+
+    scenarios[1].name = "amulets";
+    scenarios[1].weight = 20;
+    scenarios[1].spec.rows = 12;
+    scenarios[1].spec.cols = 12;
+    scenarios[1].spec.pillars = 0.05;
+    scenarios[1].spec.amulets = 0.25;
+
+    scenarios[2].name = "corridor";
+    scenarios[2].weight = 15;
+    scenarios[2].spec.rows = 3;
+    scenarios[2].spec.cols = 2048;
+    scenarios[2].spec.pillars = 0.0;
+    scenarios[2].spec.monsters = 0.4;
+    scenarios[2].spec.listed = 0.05;
+
+    scenarios[3].name = "listed";
+    scenarios[3].weight = 20;
+    scenarios[3].spec.rows = 64;
+    scenarios[3].spec.cols = 64;
+    scenarios[3].spec.monsters = 0.0;
+    scenarios[3].spec.listed = 0.08;
+
+    scenarios[4].name = "large";
+    scenarios[4].weight = 2;
+    scenarios[4].spec.rows = 512;
+    scenarios[4].spec.cols = 512;
+    scenarios[4].spec.monsters = 0.01;
+    scenarios[4].spec.listed = 0.002;
+    scenarios[4].spec.amulets = 0.0001;
+}
+
+/**
+ * Feed loadLevel a level that is valid up to one broken part, so the map it allocated has to be
+ * released on the way out; a leak shows up under -fsanitize=address or in the live bytes.
+ * @param   fileName    Scratch file of the worker.
+ * @param   random      Generator of the worker.
+ * @return  true if loadLevel rejected the level as it should.
+ * @updates random
+ */
+static bool loadBrokenLevel(const string& fileName, uint64_t& random) {
+    LevelSpec spec;
+    spec.rows = 8;
+    spec.cols = 8;
+    spec.seed = nextRandom(random);
+    string text = generateLevel(spec);
+    switch(nextRandom(random) % 4){
+        case 0:
+            // truncated tiles
+            text.resize(text.size() / 2);
+            break;
+        case 1:
+            // a tile loadLevel does not know
+            text[text.size() - 2] = 'x';
+            break;
+        case 2:
+            // trailing garbage after the last row
+            text += "+\n";
+            break;
+        default:
+            // neither door nor exit
+            std::replace(text.begin() + text.find('\n', text.find('\n') + 1), text.end(), TILE_DOOR, TILE_OPEN);
+            std::replace(text.begin() + text.find('\n', text.find('\n') + 1), text.end(), TILE_EXIT, TILE_OPEN);
+            break;
+    }
+    FILE* file = std::fopen(fileName.c_str(), "wb");
+    if(file == nullptr){
+        return false;
+    }
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+
+    int maxRow = 0;
+    int maxCol = 0;
+    Player player;
+    char** map = loadLevel(fileName, maxRow, maxCol, player);
+    if(map != nullptr){
+        deleteMap(map, maxRow);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Count the player and monster tiles of the map.
+ * @param   session     Session to scan.
+ * @param   players     Player tiles found.
+ * @return  monster tiles found.
+ * @updates players
+ */
+static size_t scanMap(const GameSession& session, int& players) {
+    size_t monsters = 0;
+    players = 0;
+    for(int row = 0; row < session.maxRow; ++row){
+        const char* cells = session.map[row];
+        for(int col = 0; col < session.maxCol; ++col){
+            players += cells[col] == TILE_PLAYER;
+            monsters += isMonsterTile(cells[col]);
+        }
+    }
+    return monsters;
+}
+
+/**
+ * Check a session after a turn that left the game running.
+ * @param   soak        Session to check.
+ * @param   fullScan    Scan the whole map, not just the player's cell.
+ * @param   monsterCap  Most monsters the map may hold, SIZE_MAX to just record the count.
+ * @param   problem     Description of the first broken invariant.
+ * @return  false if an invariant is broken.
+ * @updates soak, problem
+ */
+static bool checkSession(SoakSession& soak, bool fullScan, size_t monsterCap, string& problem) {
+    const GameSession& session = *soak.session;
+    const Player& player = session.player;
+    if(session.map == nullptr || player.row < 0 || player.col < 0 || player.row >= session.maxRow || player.col >= session.maxCol){
+        problem = "player outside the map";
+        return false;
+    }
+    if(session.map[player.row][player.col] != TILE_PLAYER){
+        problem = "no player tile at the player's position";
+        return false;
+    }
+    if(!fullScan){
+        return true;
+    }
+    int players = 0;
+    size_t monsters = scanMap(session, players);
+    if(players != 1){
+        problem = std::to_string(players) + " player tiles on the map";
+        return false;
+    }
+    if(monsters > monsterCap){
+        problem = "monsters grew from " + std::to_string(soak.monsters) + " to " + std::to_string(monsters);
+        return false;
+    }
+    soak.monsters = monsters;
+    return true;
+}
+
+/**
+ * Replace a session with a fresh game of a scenario drawn by weight.
+ * @param   worker      Worker owning the session.
+ * @param   soak        Session to restart.
+ * @param   policy      POLICY_* option of the run.
+ * @updates worker, soak
+ */
+static void startSoakSession(SoakWorker& worker, SoakSession& soak, int policy) {
+    int total = 0;
+    for(const Scenario& scenario : scenarios){
+        total += scenario.weight;
+    }
+    int draw = static_cast<int>(nextRandom(worker.random) % static_cast<uint64_t>(total));
+    const Scenario* picked = &scenarios[0];
+    for(const Scenario& scenario : scenarios){
+        if(draw < scenario.weight){
+            picked = &scenario;
+            break;
+        }
+        draw -= scenario.weight;
+    }
+
+    LevelSpec spec = picked->spec;
+    spec.seed = nextRandom(worker.random);
+    string text = generateLevel(spec);
+    LevelTemplate level;
+    parseLevel(text.data(), text.size(), level);
+    if(!soak.journal){
+        soak.journal.reset(new Journal());
+        soak.session.reset(new GameSession());
+    }
+    soak.policy = policy == POLICY_MIXED ? static_cast<int>(nextRandom(worker.random) % 2) : policy;
+    soak.session->journal = soak.policy == POLICY_BOT ? soak.journal.get() : nullptr;
+    clearJournal(*soak.journal);
+    soak.session->dungeon = picked->name;
+    soak.session->total_rooms = 1;
+    soak.session->current_room = 1;
+    soak.session->total_moves = 0;
+    soak.session->player.treasure = 0;
+    enterLevel(*soak.session, level);
+    soak.scenario = picked->name;
+    soak.seed = spec.seed;
+    soak.turns = 0;
+    int players = 0;
+    soak.monsters = scanMap(*soak.session, players);
+    worker.window.sessions++;
+}
+
+/**
+ * @param   soak        Session to move.
+ * @param   random      Generator of the worker.
+ * @return  next command: the bot walks toward the exit in the bottom-right corner, stepping
+ *          around pillars and now and then at random.
+ * @updates random
+ */
+static char chooseCommand(const SoakSession& soak, uint64_t& random) {
+    static const char MOVES[5] = {MOVE_UP, MOVE_LEFT, MOVE_DOWN, MOVE_RIGHT, INPUT_STAY};
+    uint64_t draw = nextRandom(random);
+    if(soak.policy == POLICY_RANDOM || draw % 4 == 0){
+        return MOVES[(draw >> 8) % 5];
+    }
+    const GameSession& session = *soak.session;
+    int row = session.player.row;
+    int col = session.player.col;
+    bool downOpen = row + 1 < session.maxRow && session.map[row + 1][col] != TILE_PILLAR;
+    bool rightOpen = col + 1 < session.maxCol && session.map[row][col + 1] != TILE_PILLAR;
+    if(downOpen && (!rightOpen || (draw >> 8) % 2 == 0)){
+        return MOVE_DOWN;
+    }
+    if(rightOpen){
+        return MOVE_RIGHT;
+    }
+    return MOVES[(draw >> 8) % 5];
+}
+
+/**
+ * Play one turn of a session, or undo or redo one for bots, and check the result.
+ * @param   worker      Worker owning the session.
+ * @param   soak        Session to advance.
+ * @param   policy      POLICY_* option of the run.
+ * @return  false if an invariant broke; worker.failure says which.
+ * @updates worker, soak
+ */
+static bool playSoakTurn(SoakWorker& worker, SoakSession& soak, int policy) {
+    GameSession& session = *soak.session;
+    uint64_t draw = nextRandom(worker.random);
+    string problem;
+
+    // bots walk their journal now and then, which must give back a consistent map
+    if(soak.policy == POLICY_BOT && draw % 64 < 2){
+        bool walked = draw % 64 == 0 ? undoTurn(*soak.journal, session) : redoTurn(*soak.journal, session);
+        if(walked && !checkSession(soak, true, SIZE_MAX, problem)){
+            worker.failure = problem + " after " + (draw % 64 == 0 ? "undo" : "redo");
+            return false;
+        }
+        if(walked){
+            return true;
+        }
+    }
+
+    int rowsBefore = session.maxRow;
+    int colsBefore = session.maxCol;
+    uint64_t start = monotonicNanos();
+    int turn = stepSession(session, chooseCommand(soak, worker.random));
+    recordLatency(worker.window.latency, monotonicNanos() - start);
+    worker.window.turns++;
+    soak.turns++;
+
+    if(turn != TURN_CONTINUE){
+        startSoakSession(worker, soak, policy);
+        return true;
+    }
+    bool resized = session.maxRow != rowsBefore || session.maxCol != colsBefore;
+    if(resized && (session.maxRow != rowsBefore * 2 || session.maxCol != colsBefore * 2)){
+        worker.failure = "map went from " + std::to_string(rowsBefore) + "x" + std::to_string(colsBefore) + " to "
+                         + std::to_string(session.maxRow) + "x" + std::to_string(session.maxCol);
+        return false;
+    }
+    worker.window.resizes += resized ? 1 : 0;
+    // monsters never appear, except that a resize copies the map into four quadrants
+    size_t monsterCap = resized ? soak.monsters * 4 : soak.monsters;
+    if(!checkSession(soak, resized || soak.turns % FULL_SCAN_EVERY == 0, monsterCap, problem)){
+        worker.failure = problem + (resized ? " after resizeMap" : "");
+        return false;
+    }
+    if(static_cast<long long>(session.maxRow) * session.maxCol > MAX_CELLS || soak.turns >= MAX_TURNS){
+        startSoakSession(worker, soak, policy);
+    }
+    return true;
+}
+
+/**
+ * Keep a worker's sessions playing, round robin, until the deadline, its first invalid state
+ * or another worker's. Raises stop on an invalid state so the whole run ends with it.
+ * @param   worker      Worker to run.
+ * @param   policy      POLICY_* option of the run.
+ * @param   deadline    monotonicNanos time to stop at.
+ * @param   stop        Set once any worker found an invalid state; checked after every round.
+ * @updates worker, stop
+ */
+static void runWorker(SoakWorker& worker, int policy, uint64_t deadline, std::atomic<bool>& stop) {
+    string brokenFile = (std::filesystem::temp_directory_path()
+                         / ("dungeon_soak_" + std::to_string(getpid()) + "_" + std::to_string(worker.index) + ".txt")).string();
+    std::unique_lock<std::mutex> guard(worker.lock);
+    for(SoakSession& soak : worker.sessions){
+        startSoakSession(worker, soak, policy);
+    }
+    while(!stop.load(std::memory_order_relaxed) && monotonicNanos() < deadline){
+        for(SoakSession& soak : worker.sessions){
+            uint64_t startedBefore = worker.window.sessions;
+            if(!playSoakTurn(worker, soak, policy)){
+                worker.failure += " (scenario " + string(soak.scenario) + ", seed " + std::to_string(soak.seed)
+                                  + ", turn " + std::to_string(soak.turns) + ")";
+                std::remove(brokenFile.c_str());
+                stop.store(true, std::memory_order_relaxed);
+                return;
+            }
+            if(worker.window.sessions != startedBefore && nextRandom(worker.random) % BROKEN_LEVEL_EVERY == 0){
+                if(!loadBrokenLevel(brokenFile, worker.random)){
+                    worker.failure = "loadLevel accepted a broken level";
+                    std::remove(brokenFile.c_str());
+                    stop.store(true, std::memory_order_relaxed);
+                    return;
+                }
+                worker.window.brokenLevels++;
+            }
+        }
+        // let the reporter take the window between rounds
+        guard.unlock();
+        guard.lock();
+    }
+    std::remove(brokenFile.c_str());
+}
+
+/**
+ * @return  resident set size of the process in bytes, 0 if /proc cannot be read.
+ */
+static uint64_t residentBytes() {
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    if(file == nullptr){
+        return 0;
+    }
+    unsigned long long size = 0;
+    unsigned long long resident = 0;
+    int read = std::fscanf(file, "%llu %llu", &size, &resident);
+    std::fclose(file);
+    return read == 2 ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+}
+
+/**
+ * Take every worker's window, leaving them empty.
+ * @param   workers     Running workers.
+ * @param   total       Sum of the windows.
+ * @return  first invalid state any worker found, empty if none.
+ * @updates workers, total
+ */
+static string collectWindows(vector<std::unique_ptr<SoakWorker>>& workers, SoakWindow& total) {
+    string failure;
+    for(std::unique_ptr<SoakWorker>& worker : workers){
+        std::lock_guard<std::mutex> guard(worker->lock);
+        SoakWindow& window = worker->window;
+        for(int bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket){
+            total.latency.counts[bucket] += window.latency.counts[bucket];
+        }
+        total.latency.total += window.latency.total;
+        total.latency.sum += window.latency.sum;
+        total.latency.max = std::max(total.latency.max, window.latency.max);
+        total.turns += window.turns;
+        total.sessions += window.sessions;
+        total.resizes += window.resizes;
+        total.brokenLevels += window.brokenLevels;
+        window = SoakWindow();
+        if(failure.empty() && !worker->failure.empty()){
+            failure = "thread " + std::to_string(worker->index) + ": " + worker->failure;
+        }
+    }
+    return failure;
+}
+
+int main(int argc, char* argv[]) {
+    int sessionCount = 1000;
+    int threadCount = 1;
+    double seconds = 60.0;
+    double reportSeconds = 10.0;
+    int policy = POLICY_MIXED;
+    uint64_t seed = 1;
+    double maxP99Drift = 3.0;
+    double maxRssGrowth = 1.5;
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(std::strcmp(argv[i], "--sessions") == 0){
+            sessionCount = std::atoi(argv[i + 1]);
+        } else if(std::strcmp(argv[i], "--threads") == 0){
+            threadCount = std::atoi(argv[i + 1]);
+        } else if(std::strcmp(argv[i], "--seconds") == 0){
+            seconds = std::atof(argv[i + 1]);
+        } else if(std::strcmp(argv[i], "--report") == 0){
+            reportSeconds = std::atof(argv[i + 1]);
+        } else if(std::strcmp(argv[i], "--seed") == 0){
+            seed = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if(std::strcmp(argv[i], "--max-p99-drift") == 0){
+            maxP99Drift = std::atof(argv[i + 1]);
+        } else if(std::strcmp(argv[i], "--max-rss-growth") == 0){
+            maxRssGrowth = std::atof(argv[i + 1]);
+        } else if(std::strcmp(argv[i], "--policy") == 0){
+            string name = argv[i + 1];
+            policy = name == "random" ? POLICY_RANDOM : name == "bot" ? POLICY_BOT : POLICY_MIXED;
+        }
+    }
+    if(sessionCount <= 0 || threadCount <= 0 || seconds <= 0.0 || reportSeconds <= 0.0){
+        std::fprintf(stderr, "sessions, threads, seconds and report must be positive\n");
+        return 2;
+    }
+    setupScenarios();
+
+    uint64_t start = monotonicNanos();
+    uint64_t deadline = start + static_cast<uint64_t>(seconds * 1e9);
+    vector<std::unique_ptr<SoakWorker>> workers;
+    std::atomic<bool> stop(false);
+    for(int index = 0; index < threadCount; ++index){
+        std::unique_ptr<SoakWorker> worker(new SoakWorker());
+        worker->index = index;
+        worker->random = seed * 0x100000001B3ULL + static_cast<uint64_t>(index);
+        worker->sessions.resize(sessionCount / threadCount + (index < sessionCount % threadCount ? 1 : 0));
+        workers.push_back(std::move(worker));
+    }
+    for(std::unique_ptr<SoakWorker>& worker : workers){
+        SoakWorker* running = worker.get();
+        worker->thread = std::thread([running, policy, deadline, &stop]() { runWorker(*running, policy, deadline, stop); });
+    }
+
+    // report each window, and at once when a worker finds an invalid state; the first window is
+    // warm-up, the drift checks compare the second with the last
+    std::printf("%8s %12s %10s %10s %10s %10s %9s %8s %12s %12s\n", "seconds", "turns", "turns/s", "p50 us", "p99 us",
+                "max us", "sessions", "resizes", "rss MiB", "live MiB");
+    string failure;
+    int windows = 0;
+    uint64_t baselineP99 = 0;
+    uint64_t baselineRss = 0;
+    uint64_t lastP99 = 0;
+    uint64_t lastRss = 0;
+    uint64_t brokenLevels = 0;
+    uint64_t windowStart = start;
+    while(failure.empty()){
+        uint64_t now = monotonicNanos();
+        uint64_t next = std::min(deadline, windowStart + static_cast<uint64_t>(reportSeconds * 1e9));
+        if(now < next && !stop.load(std::memory_order_relaxed)){
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<uint64_t>(next - now, 100000000)));
+            continue;
+        }
+        SoakWindow window;
+        failure = collectWindows(workers, window);
+        brokenLevels += window.brokenLevels;
+        uint64_t rss = residentBytes();
+        double elapsed = static_cast<double>(now - windowStart) / 1e9;
+        std::printf("%8.0f %12llu %10.0f %10.1f %10.1f %10.1f %9llu %8llu %12.1f %12.1f\n",
+                    static_cast<double>(now - start) / 1e9, static_cast<unsigned long long>(window.turns),
+                    static_cast<double>(window.turns) / elapsed,
+                    static_cast<double>(latencyPercentile(window.latency, 50.0)) / 1000.0,
+                    static_cast<double>(latencyPercentile(window.latency, 99.0)) / 1000.0,
+                    static_cast<double>(window.latency.max) / 1000.0, static_cast<unsigned long long>(window.sessions),
+                    static_cast<unsigned long long>(window.resizes), static_cast<double>(rss) / 1048576.0,
+                    static_cast<double>(allocationStats().liveBytes) / 1048576.0);
+        std::fflush(stdout);
+        windows++;
+        if(windows == 2){
+            baselineP99 = latencyPercentile(window.latency, 99.0);
+            baselineRss = rss;
+        }
+        lastP99 = latencyPercentile(window.latency, 99.0);
+        lastRss = rss;
+        windowStart = now;
+        if(now >= deadline || stop.load(std::memory_order_relaxed)){
+            break;
+        }
+    }
+    stop.store(true, std::memory_order_relaxed);
+    for(std::unique_ptr<SoakWorker>& worker : workers){
+        worker->thread.join();
+    }
+    if(failure.empty()){
+        SoakWindow rest;
+        failure = collectWindows(workers, rest);
+    }
+
+    std::printf("broken levels rejected by loadLevel: %llu\n", static_cast<unsigned long long>(brokenLevels));
+    if(!failure.empty()){
+        std::printf("INVALID STATE: %s\n", failure.c_str());
+        return 1;
+    }
+    int status = 0;
+    if(windows > 2 && baselineP99 > 0){
+        double drift = static_cast<double>(lastP99) / static_cast<double>(baselineP99);
+        std::printf("p99 drift %.2fx (limit %.2fx)\n", drift, maxP99Drift);
+        status = drift > maxP99Drift ? 1 : status;
+    }
+    if(windows > 2 && baselineRss > 0){
+        double growth = static_cast<double>(lastRss) / static_cast<double>(baselineRss);
+        std::printf("rss growth %.2fx (limit %.2fx)\n", growth, maxRssGrowth);
+        status = growth > maxRssGrowth ? 1 : status;
+    }
+    std::printf(status == 0 ? "soak passed\n" : "soak FAILED: drift beyond the limits\n");
+    return status;
+}
@@ -0,0 +1,112 @@
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include "latency.h"
+#include "trace.h"
+
+using std::string;
+
+// ring of the latest events of one thread, written only by that thread
+struct TraceBuffer {
+    std::vector<TraceEvent> events{};
+    uint64_t written = 0;       // events ever written; the slot of the next one is written % size
+    int thread = 0;             // tid shown in the trace
+};
+
+// registry of every thread's buffer; buffers outlive their threads so they can be flushed at exit
+static std::mutex traceLock;
+static std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+static string traceFile;
+static std::atomic<bool> traceOn{false};
+
+// this thread's buffer, registered on its first event
+static thread_local TraceBuffer* localBuffer = nullptr;
+
+TraceSpan::TraceSpan(const char* name)
+    : name(name), start(tracing() ? monotonicNanos() : 0) {
+}
+
+TraceSpan::~TraceSpan() {
+    if(start != 0){
+        traceEvent(name, start, monotonicNanos());
+    }
+}
+
+/**
+ * Start recording spans, to be written as Chrome trace events by flushTrace.
+ * @param   fileName    JSON file to write.
+ */
+void startTrace(const string& fileName) {
+    std::lock_guard<std::mutex> guard(traceLock);
+    traceFile = fileName;
+    traceOn.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * @return  true if spans are being recorded.
+ */
+bool tracing() {
+    return traceOn.load(std::memory_order_relaxed);
+}
+
+/**
+ * Record a finished span in this thread's ring buffer. Takes a lock only on the thread's first event.
+ * @param   name        Span name, a static string.
+ * @param   start       Start in monotonicNanos time.
+ * @param   end         End in monotonicNanos time.
+ */
+void traceEvent(const char* name, uint64_t start, uint64_t end) {
+    if(!tracing()){
+        return;
+    }
+    TraceBuffer* buffer = localBuffer;
+    if(buffer == nullptr){
+        std::lock_guard<std::mutex> guard(traceLock);
+        traceBuffers.emplace_back(new TraceBuffer());
+        buffer = traceBuffers.back().get();
+        buffer->events.resize(TRACE_BUFFER_EVENTS);
+        buffer->thread = static_cast<int>(traceBuffers.size());
+        localBuffer = buffer;
+    }
+    TraceEvent& event = buffer->events[buffer->written % TRACE_BUFFER_EVENTS];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    buffer->written++;
+}
+
+/**
+ * Write every thread's recorded spans to the trace file as Chrome trace-event JSON, readable
+ * by about:tracing and Perfetto. Call once the threads that trace have stopped.
+ * @return  false if tracing is off or the file cannot be written.
+ */
+bool flushTrace() {
+    std::lock_guard<std::mutex> guard(traceLock);
+    if(!traceOn.load(std::memory_order_relaxed)){
+        return false;
+    }
+    std::FILE* file = std::fopen(traceFile.c_str(), "w");
+    if(file == nullptr){
+        return false;
+    }
+    const int pid = static_cast<int>(getpid());
+    std::fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    std::fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": 0, \"args\": {\"name\": \"dungeoncrawler\"}}", pid);
+    for(const std::unique_ptr<TraceBuffer>& buffer : traceBuffers){
+        uint64_t first = buffer->written > TRACE_BUFFER_EVENTS ? buffer->written - TRACE_BUFFER_EVENTS : 0;
+        std::fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"thread %d\", \"dropped\": %llu}}",
+                     pid, buffer->thread, buffer->thread, static_cast<unsigned long long>(first));
+        for(uint64_t i = first; i < buffer->written; ++i){
+            const TraceEvent& event = buffer->events[i % TRACE_BUFFER_EVENTS];
+            // timestamps and durations are in microseconds
+            std::fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                         event.name, pid, buffer->thread, static_cast<double>(event.start) / 1000.0,
+                         static_cast<double>(event.end - event.start) / 1000.0);
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+}
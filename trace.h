@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <cstdint>
+#include <string>
+
+// events kept per thread; once full, the oldest are overwritten
+const int TRACE_BUFFER_EVENTS = 1 << 16;
+
+// one complete span, in monotonicNanos time
+struct TraceEvent {
+    const char* name = nullptr; // static string
+    uint64_t start = 0;
+    uint64_t end = 0;
+};
+
+// times a span of code into the trace; does nothing unless tracing
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name);
+    ~TraceSpan();
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;             // 0 when not tracing
+};
+
+// function signatures
+void startTrace(const std::string& fileName);
+
+bool tracing();
+
+void traceEvent(const char* name, uint64_t start, uint64_t end);
+
+bool flushTrace();
+
+#endif